@@ -0,0 +1,39 @@
+TEMPLATE = app
+CONFIG += console c++2a
+CONFIG -= app_bundle
+CONFIG -= qt
+
+SOURCES += \
+    load_test_main.cpp \
+    load_generator.cpp \
+    parse.cpp \
+    search_server.cpp \
+    pair_cache.cpp \
+    doc_store.cpp \
+    term_dictionary.cpp \
+    query_explain.cpp \
+    query_pipeline.cpp \
+    thread_pool.cpp \
+    priority_scheduler.cpp \
+    profile.cpp
+
+HEADERS += \
+    load_generator.h \
+    iterator_range.h \
+    doc_bitmap.h \
+    doc_store.h \
+    parse.h \
+    search_server.h \
+    pair_cache.h \
+    hits_pool.h \
+    top_k.h \
+    term_dictionary.h \
+    query_explain.h \
+    query_pipeline.h \
+    stage_stats.h \
+    coro.h \
+    executor.h \
+    thread_pool.h \
+    priority_scheduler.h \
+    profile.h \
+    synchronized.h
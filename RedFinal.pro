@@ -1,5 +1,5 @@
 TEMPLATE = app
-CONFIG += console c++1z
+CONFIG += console c++2a
 CONFIG -= app_bundle
 CONFIG -= qt
 
@@ -7,13 +7,39 @@ SOURCES += \
     main.cpp \
     parse.cpp \
     search_server.cpp \
+    pair_cache.cpp \
+    doc_store.cpp \
+    term_dictionary.cpp \
+    query_explain.cpp \
+    query_pipeline.cpp \
+    shard.cpp \
+    thread_pool.cpp \
+    priority_scheduler.cpp \
+    query_frontend.cpp \
+    load_generator.cpp \
     profile.cpp \
     test_runner.cpp
 
 HEADERS += \
     iterator_range.h \
+    doc_bitmap.h \
+    doc_store.h \
     parse.h \
     search_server.h \
+    pair_cache.h \
+    hits_pool.h \
+    top_k.h \
+    term_dictionary.h \
+    query_explain.h \
+    query_pipeline.h \
+    stage_stats.h \
+    coro.h \
+    shard.h \
+    executor.h \
+    thread_pool.h \
+    priority_scheduler.h \
+    query_frontend.h \
+    load_generator.h \
     profile.h \
     test_runner.h \
     synchronized.h
@@ -0,0 +1,270 @@
+#pragma once
+
+#include <algorithm>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+#include "executor.h"
+
+using namespace std;
+
+// Fire-and-forget coroutine. It is created suspended, Start() resumes it on
+// an executor and the frame frees itself when the body finishes. The body
+// must not let exceptions escape.
+class Task
+{
+public:
+    struct promise_type
+    {
+        Task get_return_object()
+        {
+            return Task(coroutine_handle<promise_type>::from_promise(*this));
+        }
+        suspend_always initial_suspend() noexcept
+        {
+            return {};
+        }
+        suspend_never final_suspend() noexcept
+        {
+            return {};
+        }
+        void return_void()
+        {}
+        void unhandled_exception()
+        {
+            terminate();
+        }
+    };
+
+    Task(Task&& other) noexcept :
+        m_handle(exchange(other.m_handle, nullptr))
+    {}
+    ~Task()
+    {
+        if (m_handle)
+            m_handle.destroy();
+    }
+
+    void Start(Executor& executor)
+    {
+        executor.Post([handle = exchange(m_handle, nullptr)] { handle.resume(); });
+    }
+
+private:
+    explicit Task(coroutine_handle<promise_type> handle) :
+        m_handle(handle)
+    {}
+
+    coroutine_handle<promise_type> m_handle;
+};
+
+// Lets the executor run other work before the awaiting coroutine goes on
+struct Yield
+{
+    Executor& executor;
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+    void await_suspend(coroutine_handle<> handle)
+    {
+        executor.Post([handle] { handle.resume(); });
+    }
+    void await_resume() const noexcept
+    {}
+};
+
+// Bounded FIFO between coroutines. A coroutine that finds the channel full
+// (Send) or empty (Receive) is suspended without holding a thread and is
+// resumed on the executor it passed in once the other side makes progress.
+template <typename T>
+class Channel
+{
+public:
+    explicit Channel(size_t capacity) :
+        m_capacity(max<size_t>(capacity, 1))
+    {}
+
+    class SendAwaiter;
+    class ReceiveAwaiter;
+
+    // co_await yields false if the channel was closed and value dropped
+    SendAwaiter Send(T value, Executor& executor)
+    {
+        return SendAwaiter(*this, move(value), executor);
+    }
+
+    // co_await yields nullopt once the channel is closed and drained
+    ReceiveAwaiter Receive(Executor& executor)
+    {
+        return ReceiveAwaiter(*this, executor);
+    }
+
+    // Ends the stream; with discard pending values are dropped as well
+    void Close(bool discard = false)
+    {
+        deque<Waiter> receivers;
+        deque<Waiter> senders;
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_closed = true;
+
+            if (discard)
+            {
+                m_items.clear();
+                swap(senders, m_senders);
+            }
+            swap(receivers, m_receivers);
+        }
+        for (auto& sender : senders)
+        {
+            *sender.accepted = false;
+            Resume(sender);
+        }
+        for (auto& receiver : receivers)
+        {
+            Resume(receiver);
+        }
+    }
+
+private:
+    struct Waiter
+    {
+        coroutine_handle<> handle;
+        Executor* executor;
+        // Sender: the value to hand over; receiver: where to put it
+        optional<T>* slot;
+        bool* accepted = nullptr;
+    };
+
+    static void Resume(const Waiter& waiter)
+    {
+        waiter.executor->Post([handle = waiter.handle] { handle.resume(); });
+    }
+
+public:
+    class SendAwaiter
+    {
+    public:
+        SendAwaiter(Channel& channel, T&& value, Executor& executor) :
+            m_channel(channel),
+            m_value(move(value)),
+            m_executor(executor)
+        {}
+
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+
+        bool await_suspend(coroutine_handle<> handle)
+        {
+            optional<Waiter> receiver;
+            {
+                lock_guard<mutex> lock(m_channel.m_mutex);
+
+                if (m_channel.m_closed)
+                {
+                    m_accepted = false;
+                    return false;
+                }
+                if (!m_channel.m_receivers.empty())
+                {
+                    receiver = m_channel.m_receivers.front();
+                    m_channel.m_receivers.pop_front();
+                    *receiver->slot = move(m_value);
+                }
+                else if (m_channel.m_items.size() < m_channel.m_capacity)
+                {
+                    m_channel.m_items.push_back(move(*m_value));
+                }
+                else
+                {
+                    m_channel.m_senders.push_back({handle, &m_executor, &m_value, &m_accepted});
+                    return true;
+                }
+            }
+            if (receiver)
+                Resume(*receiver);
+            return false;
+        }
+
+        bool await_resume() const noexcept
+        {
+            return m_accepted;
+        }
+
+    private:
+        Channel& m_channel;
+        optional<T> m_value;
+        Executor& m_executor;
+        bool m_accepted = true;
+    };
+
+    class ReceiveAwaiter
+    {
+    public:
+        ReceiveAwaiter(Channel& channel, Executor& executor) :
+            m_channel(channel),
+            m_executor(executor)
+        {}
+
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+
+        bool await_suspend(coroutine_handle<> handle)
+        {
+            optional<Waiter> sender;
+            {
+                lock_guard<mutex> lock(m_channel.m_mutex);
+
+                if (!m_channel.m_items.empty())
+                {
+                    m_value = move(m_channel.m_items.front());
+                    m_channel.m_items.pop_front();
+
+                    // Senders only wait while the channel is full
+                    if (!m_channel.m_senders.empty())
+                    {
+                        sender = m_channel.m_senders.front();
+                        m_channel.m_senders.pop_front();
+                        m_channel.m_items.push_back(move(**sender->slot));
+                    }
+                }
+                else if (!m_channel.m_closed)
+                {
+                    m_channel.m_receivers.push_back({handle, &m_executor, &m_value});
+                    return true;
+                }
+            }
+            if (sender)
+                Resume(*sender);
+            return false;
+        }
+
+        optional<T> await_resume()
+        {
+            return move(m_value);
+        }
+
+    private:
+        Channel& m_channel;
+        Executor& m_executor;
+        optional<T> m_value;
+    };
+
+private:
+    mutex m_mutex;
+    deque<T> m_items;
+    deque<Waiter> m_receivers;
+    deque<Waiter> m_senders;
+    size_t m_capacity;
+    bool m_closed = false;
+};
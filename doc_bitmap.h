@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// Fixed-universe set of docids, one bit per document
+class DocBitmap
+{
+public:
+    DocBitmap() = default;
+    explicit DocBitmap(size_t universe) :
+        m_words((universe + WORD_BITS - 1) / WORD_BITS, 0)
+    {}
+
+    void Set(size_t docid)
+    {
+        m_words[docid / WORD_BITS] |= uint64_t(1) << (docid % WORD_BITS);
+    }
+
+    size_t Count() const
+    {
+        size_t result = 0;
+
+        for (uint64_t word : m_words)
+        {
+            result += __builtin_popcountll(word);
+        }
+        return result;
+    }
+
+    size_t MemoryBytes() const
+    {
+        return m_words.capacity() * sizeof(uint64_t);
+    }
+
+    static size_t MemoryBytes(size_t universe)
+    {
+        return (universe + WORD_BITS - 1) / WORD_BITS * sizeof(uint64_t);
+    }
+
+    template <typename Func>
+    void ForEach(Func func) const
+    {
+        for (size_t i = 0; i < m_words.size(); ++i)
+        {
+            for (uint64_t word = m_words[i]; word != 0; word &= word - 1)
+            {
+                func(i * WORD_BITS + __builtin_ctzll(word));
+            }
+        }
+    }
+
+private:
+    static const size_t WORD_BITS = 64;
+    vector<uint64_t> m_words;
+};
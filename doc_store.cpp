@@ -0,0 +1,210 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "doc_store.h"
+
+using namespace std;
+
+namespace
+{
+const size_t MIN_MATCH = 4;
+// End of block rules of LZ4: the last match starts at least MATCH_LIMIT
+// bytes before the end, and the last LAST_LITERALS bytes are literals
+const size_t MATCH_LIMIT = 12;
+const size_t LAST_LITERALS = 5;
+const size_t MAX_OFFSET = 65535;
+const size_t HASH_BITS = 12;
+const uint32_t NO_POSITION = UINT32_MAX;
+// Token nibble value saying the length continues in the following bytes
+const size_t LENGTH_MORE = 15;
+
+void WriteLength(string& output, size_t length)
+{
+    for ( ; length >= 255; length -= 255)
+    {
+        output.push_back(char(255));
+    }
+    output.push_back(char(length));
+}
+
+size_t ReadLength(const unsigned char*& in, const unsigned char* end, size_t nibble)
+{
+    size_t length = nibble;
+
+    if (nibble == LENGTH_MORE)
+    {
+        unsigned char byte;
+
+        do
+        {
+            if (in == end)
+                throw runtime_error("truncated compressed block");
+            byte = *in++;
+            length += byte;
+        }
+        while (byte == 255);
+    }
+    return length;
+}
+
+// A zero offset ends the block with literals only
+void WriteSequence(string& output, string_view literals, size_t offset, size_t match_length)
+{
+    const size_t matchCode = offset > 0 ? match_length - MIN_MATCH : 0;
+    output.push_back(char(min(literals.size(), LENGTH_MORE) << 4 | min(matchCode, LENGTH_MORE)));
+
+    if (literals.size() >= LENGTH_MORE)
+        WriteLength(output, literals.size() - LENGTH_MORE);
+
+    output.append(literals);
+
+    if (offset == 0)
+        return;
+
+    output.push_back(char(offset & 0xFF));
+    output.push_back(char(offset >> 8));
+
+    if (matchCode >= LENGTH_MORE)
+        WriteLength(output, matchCode - LENGTH_MORE);
+}
+}
+
+void CompressBlock(string_view input, string& output)
+{
+    vector<uint32_t> table(size_t(1) << HASH_BITS, NO_POSITION);
+    size_t anchor = 0;
+    size_t pos = 0;
+
+    while (pos + MATCH_LIMIT <= input.size())
+    {
+        uint32_t sequence;
+        memcpy(&sequence, input.data() + pos, sizeof(sequence));
+        uint32_t& slot = table[(sequence * 2654435761u) >> (32 - HASH_BITS)];
+        const size_t candidate = slot;
+        slot = static_cast<uint32_t>(pos);
+
+        if (candidate == NO_POSITION || pos - candidate > MAX_OFFSET
+                || memcmp(input.data() + candidate, input.data() + pos, MIN_MATCH) != 0)
+        {
+            ++pos;
+            continue;
+        }
+
+        size_t length = MIN_MATCH;
+
+        while (pos + length + LAST_LITERALS < input.size()
+                && input[candidate + length] == input[pos + length])
+        {
+            ++length;
+        }
+        WriteSequence(output, input.substr(anchor, pos - anchor), pos - candidate, length);
+        pos += length;
+        anchor = pos;
+    }
+    WriteSequence(output, input.substr(anchor), 0, 0);
+}
+
+void DecompressBlock(string_view input, size_t decompressed_size, string& output)
+{
+    output.clear();
+    output.reserve(decompressed_size);
+    auto in = reinterpret_cast<const unsigned char*>(input.data());
+    const auto end = in + input.size();
+
+    while (in < end)
+    {
+        const unsigned char token = *in++;
+        const size_t literals = ReadLength(in, end, token >> 4);
+
+        if (size_t(end - in) < literals)
+            throw runtime_error("truncated compressed block");
+
+        output.append(reinterpret_cast<const char*>(in), literals);
+        in += literals;
+
+        if (in == end)
+            break;
+
+        if (end - in < 2)
+            throw runtime_error("truncated compressed block");
+
+        const size_t offset = in[0] | size_t(in[1]) << 8;
+        in += 2;
+        const size_t length = ReadLength(in, end, token & 0x0F) + MIN_MATCH;
+
+        if (offset == 0 || offset > output.size())
+            throw runtime_error("bad match offset in compressed block");
+
+        // The match may overlap the bytes it produces
+        for (size_t from = output.size() - offset, i = 0; i < length; ++i)
+        {
+            output.push_back(output[from + i]);
+        }
+    }
+    if (output.size() != decompressed_size)
+        throw runtime_error("compressed block has the wrong size");
+}
+
+CompressedDocuments::CompressedDocuments(const deque<string>& documents)
+{
+    m_docEnds.reserve(documents.size());
+    string block;
+    block.reserve(BLOCK_SIZE);
+
+    for (size_t id = 0; id < documents.size(); ++id)
+    {
+        const string& document = documents[id];
+
+        if (!block.empty() && block.size() + document.size() > BLOCK_SIZE)
+        {
+            AddBlock(block);
+            block.clear();
+        }
+        if (block.empty())
+            m_blockFirstDoc.push_back(id);
+
+        block += document;
+        m_docEnds.push_back(static_cast<uint32_t>(block.size()));
+    }
+    if (!block.empty() || m_blockFirstDoc.size() > m_blockOffsets.size())
+        AddBlock(block);
+
+    m_arena.shrink_to_fit();
+    m_blockOffsets.shrink_to_fit();
+    m_blockSizes.shrink_to_fit();
+    m_blockFirstDoc.shrink_to_fit();
+}
+
+void CompressedDocuments::AddBlock(string_view block)
+{
+    m_blockOffsets.push_back(m_arena.size());
+    m_blockSizes.push_back(static_cast<uint32_t>(block.size()));
+    CompressBlock(block, m_arena);
+}
+
+string CompressedDocuments::Get(size_t id) const
+{
+    if (id >= size())
+        throw out_of_range("no document " + to_string(id));
+
+    const size_t block = upper_bound(m_blockFirstDoc.begin(), m_blockFirstDoc.end(), id)
+                       - m_blockFirstDoc.begin() - 1;
+    const size_t first = m_blockOffsets[block];
+    const size_t last = block + 1 < m_blockOffsets.size() ? m_blockOffsets[block + 1]
+                                                          : m_arena.size();
+    string data;
+    DecompressBlock(string_view(m_arena).substr(first, last - first), m_blockSizes[block], data);
+
+    const size_t start = id == m_blockFirstDoc[block] ? 0 : m_docEnds[id - 1];
+    return data.substr(start, m_docEnds[id] - start);
+}
+
+size_t CompressedDocuments::MemoryBytes() const
+{
+    return (m_arena.empty() ? 0 : m_arena.capacity())
+         + m_blockOffsets.capacity() * sizeof(size_t)
+         + m_blockSizes.capacity() * sizeof(uint32_t)
+         + m_blockFirstDoc.capacity() * sizeof(size_t)
+         + m_docEnds.capacity() * sizeof(uint32_t);
+}
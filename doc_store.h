@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+// LZ4 block format: sequences of literals followed by a back reference of
+// at least 4 bytes within the last 64 KiB; the last sequence is literals
+// only, and holds at least the last 5 bytes. No match starts in the last
+// 12 bytes.
+void CompressBlock(string_view input, string& output);
+void DecompressBlock(string_view input, size_t decompressed_size, string& output);
+
+// Documents packed back to back into blocks of about BLOCK_SIZE bytes, each
+// compressed on its own into one arena. Get decompresses the block holding
+// the document, so reading one document costs at most one block.
+class CompressedDocuments
+{
+public:
+    static const size_t BLOCK_SIZE = 16 * 1024;
+
+    CompressedDocuments() = default;
+    explicit CompressedDocuments(const deque<string>& documents);
+
+    size_t size() const
+    {
+        return m_docEnds.size();
+    }
+
+    string Get(size_t id) const;
+    size_t MemoryBytes() const;
+
+private:
+    void AddBlock(string_view block);
+
+    string m_arena;
+    // Per block: where its compressed bytes start in m_arena, its size
+    // when decompressed and the id of its first document
+    vector<size_t> m_blockOffsets;
+    vector<uint32_t> m_blockSizes;
+    vector<size_t> m_blockFirstDoc;
+    // Per document: where it ends in its decompressed block
+    vector<uint32_t> m_docEnds;
+};
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <functional>
+
+using namespace std;
+
+// Something that runs posted tasks, usually on other threads
+class Executor
+{
+public:
+    virtual ~Executor() = default;
+    virtual void Post(function<void()> task) = 0;
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+// docHits vectors handed back after ranking and reused by later lookups.
+// One pool serves every stream of every index, so the buffers kept follow
+// the number of queries in flight rather than the number of streams.
+class HitsBufferPool
+{
+public:
+    vector<size_t> Take()
+    {
+        lock_guard<mutex> lock(m_mutex);
+        vector<size_t> result;
+
+        if (!m_free.empty())
+        {
+            result = move(m_free.back());
+            m_free.pop_back();
+        }
+        return result;
+    }
+
+    void Return(vector<size_t>&& docHits)
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_free.push_back(move(docHits));
+    }
+
+private:
+    mutex m_mutex;
+    vector<vector<size_t>> m_free;
+};
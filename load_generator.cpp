@@ -0,0 +1,181 @@
+#include <algorithm>
+#include <mutex>
+#include <sstream>
+#include <streambuf>
+#include <thread>
+
+#include "load_generator.h"
+
+using namespace std;
+
+namespace
+{
+using Clock = chrono::steady_clock;
+
+class NullBuffer : public streambuf
+{
+protected:
+    int overflow(int c) override
+    {
+        return c;
+    }
+    streamsize xsputn(const char*, streamsize count) override
+    {
+        return count;
+    }
+};
+
+struct Sample
+{
+    Clock::time_point due;
+    chrono::nanoseconds latency;
+};
+
+struct UpdateWindow
+{
+    Clock::time_point start;
+    Clock::time_point finish;
+};
+
+LatencySummary Summarize(vector<chrono::nanoseconds> latencies)
+{
+    LatencySummary summary;
+    summary.count = latencies.size();
+
+    if (latencies.empty())
+        return summary;
+
+    sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double p)
+    {
+        const size_t rank = static_cast<size_t>(p * (latencies.size() - 1) + 0.5);
+        return latencies[rank];
+    };
+    summary.p50 = percentile(0.5);
+    summary.p90 = percentile(0.9);
+    summary.p99 = percentile(0.99);
+    summary.p999 = percentile(0.999);
+    summary.max = latencies.back();
+    return summary;
+}
+
+double Milliseconds(chrono::nanoseconds duration)
+{
+    return duration.count() / 1e6;
+}
+}
+
+ostream& operator << (ostream& os, const LatencySummary& summary)
+{
+    return os << "count: " << summary.count
+              << ", p50: " << Milliseconds(summary.p50) << " ms"
+              << ", p90: " << Milliseconds(summary.p90) << " ms"
+              << ", p99: " << Milliseconds(summary.p99) << " ms"
+              << ", p99.9: " << Milliseconds(summary.p999) << " ms"
+              << ", max: " << Milliseconds(summary.max) << " ms";
+}
+
+ostream& operator << (ostream& os, const LoadTestReport& report)
+{
+    return os << "target qps: " << report.target_qps
+              << ", achieved qps: " << report.achieved_qps
+              << ", updates: " << report.updates << '\n'
+              << "  all:             " << report.all << '\n'
+              << "  during updates:  " << report.during_updates << '\n'
+              << "  between updates: " << report.between_updates << '\n';
+}
+
+LoadTestReport RunLoadTest(SearchServer& server,
+                           const vector<string>& queries,
+                           const LoadTestOptions& options)
+{
+    LoadTestReport report;
+    report.target_qps = options.target_qps;
+
+    if (queries.empty() || options.target_qps <= 0 || options.streams == 0)
+        return report;
+
+    const size_t total = static_cast<size_t>(
+            chrono::duration<double>(options.duration).count() * options.target_qps);
+    const auto start = Clock::now();
+
+    vector<vector<Sample>> samples(options.streams);
+    vector<thread> senders;
+    Clock::time_point lastFinish = start;
+    mutex lastFinishMutex;
+
+    for (size_t stream = 0; stream < options.streams; ++stream)
+    {
+        senders.emplace_back([&, stream]
+        {
+            NullBuffer nullBuffer;
+            ostream discard(&nullBuffer);
+            auto& streamSamples = samples[stream];
+            streamSamples.reserve(total / options.streams + 1);
+            Clock::time_point finish = start;
+
+            for (size_t n = stream; n < total; n += options.streams)
+            {
+                const auto due = start + chrono::duration_cast<Clock::duration>(
+                        chrono::duration<double>(n / options.target_qps));
+                this_thread::sleep_until(due);
+                server.AnswerQuery(queries[n % queries.size()], discard);
+                finish = Clock::now();
+                streamSamples.push_back({due, finish - due});
+            }
+
+            lock_guard<mutex> lock(lastFinishMutex);
+            lastFinish = max(lastFinish, finish);
+        });
+    }
+
+    vector<UpdateWindow> updates;
+
+    if (!options.update_documents.empty() && options.update_period.count() > 0)
+    {
+        const auto end = start + options.duration;
+
+        for (auto due = start + options.update_period; due < end; due += options.update_period)
+        {
+            this_thread::sleep_until(due);
+            istringstream documents(options.update_documents);
+            UpdateWindow window{Clock::now(), {}};
+            server.UpdateDocumentBase(documents);
+            server.WaitForAllTasks();
+            window.finish = Clock::now();
+            updates.push_back(window);
+        }
+    }
+
+    for (auto& sender : senders)
+    {
+        sender.join();
+    }
+
+    vector<chrono::nanoseconds> all;
+    vector<chrono::nanoseconds> during;
+    vector<chrono::nanoseconds> between;
+    all.reserve(total);
+
+    for (const auto& streamSamples : samples)
+    {
+        for (const auto& sample : streamSamples)
+        {
+            all.push_back(sample.latency);
+            const bool inUpdate = any_of(updates.begin(), updates.end(),
+                                         [&sample](const UpdateWindow& window)
+            {
+                return sample.due >= window.start && sample.due < window.finish;
+            });
+            (inUpdate ? during : between).push_back(sample.latency);
+        }
+    }
+
+    report.updates = updates.size();
+    const double elapsed = chrono::duration<double>(lastFinish - start).count();
+    report.achieved_qps = elapsed > 0 ? all.size() / elapsed : 0;
+    report.all = Summarize(move(all));
+    report.during_updates = Summarize(move(during));
+    report.between_updates = Summarize(move(between));
+    return report;
+}
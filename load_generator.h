@@ -0,0 +1,55 @@
+#pragma once
+
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "search_server.h"
+
+using namespace std;
+
+struct LoadTestOptions
+{
+    double target_qps = 1000;
+    size_t streams = 4;
+    chrono::milliseconds duration{10000};
+    // Document base text swapped in every update_period; none when empty
+    string update_documents;
+    chrono::milliseconds update_period{0};
+};
+
+struct LatencySummary
+{
+    size_t count = 0;
+    chrono::nanoseconds p50{};
+    chrono::nanoseconds p90{};
+    chrono::nanoseconds p99{};
+    chrono::nanoseconds p999{};
+    chrono::nanoseconds max{};
+};
+
+// Latencies are measured from the moment a query was scheduled to be sent,
+// not from when it was actually sent, so a server that falls behind is
+// charged for the whole queueing delay (coordinated omission correction).
+struct LoadTestReport
+{
+    double target_qps = 0;
+    double achieved_qps = 0;
+    size_t updates = 0;
+    LatencySummary all;
+    // Split by whether the query was scheduled while an update was running
+    LatencySummary during_updates;
+    LatencySummary between_updates;
+};
+
+ostream& operator << (ostream& os, const LatencySummary& summary);
+ostream& operator << (ostream& os, const LoadTestReport& report);
+
+// Replays queries open-loop against server: query n of the log is due at
+// n / target_qps, and the due queries are spread over options.streams
+// concurrent senders, each taking every streams-th query and wrapping
+// around the log until options.duration is over.
+LoadTestReport RunLoadTest(SearchServer& server,
+                           const vector<string>& queries,
+                           const LoadTestOptions& options);
@@ -0,0 +1,115 @@
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "load_generator.h"
+#include "parse.h"
+
+using namespace std;
+
+namespace
+{
+void PrintUsage()
+{
+    cerr << "Usage: LoadTest --docs FILE --queries FILE [--qps N[,N...]] [--streams K]\n"
+            "                [--duration SEC] [--update-docs FILE --update-period SEC]\n"
+            "                [--pair-cache BYTES]\n"
+            "Runs one open-loop pass per target QPS and prints latency percentiles.\n";
+}
+
+string ReadFile(const string& path)
+{
+    ifstream input(path, ios::binary);
+
+    if (!input)
+        throw runtime_error("cannot open " + path);
+
+    return {istreambuf_iterator<char>(input), istreambuf_iterator<char>()};
+}
+}
+
+int main(int argc, char* argv[])
+{
+    string docsPath;
+    string queriesPath;
+    string updateDocsPath;
+    vector<double> targets = {1000};
+    size_t pairCacheBytes = 0;
+    LoadTestOptions options;
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        const string flag = argv[i];
+        const string value = argv[i + 1];
+
+        if (flag == "--docs")
+            docsPath = value;
+        else if (flag == "--queries")
+            queriesPath = value;
+        else if (flag == "--update-docs")
+            updateDocsPath = value;
+        else if (flag == "--streams")
+            options.streams = stoul(value);
+        else if (flag == "--duration")
+            options.duration = chrono::milliseconds(static_cast<long>(stod(value) * 1000));
+        else if (flag == "--update-period")
+            options.update_period = chrono::milliseconds(static_cast<long>(stod(value) * 1000));
+        else if (flag == "--pair-cache")
+            pairCacheBytes = stoul(value);
+        else if (flag == "--qps")
+        {
+            targets.clear();
+
+            for (string_view target : SplitBy(value, ','))
+            {
+                targets.push_back(stod(string(target)));
+            }
+        }
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (docsPath.empty() || queriesPath.empty() || argc % 2 == 0)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    try
+    {
+        istringstream docs(ReadFile(docsPath));
+        SearchServer server(docs);
+        server.WaitForAllTasks();
+        server.SetPairCacheBudget(pairCacheBytes);
+
+        vector<string> queries;
+        istringstream queriesInput(ReadFile(queriesPath));
+
+        for (string query; getline(queriesInput, query); )
+        {
+            if (!query.empty())
+                queries.push_back(move(query));
+        }
+
+        if (!updateDocsPath.empty())
+            options.update_documents = ReadFile(updateDocsPath);
+
+        for (double target : targets)
+        {
+            options.target_qps = target;
+            cout << RunLoadTest(server, queries, options) << flush;
+        }
+    }
+    catch (exception& e)
+    {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
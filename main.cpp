@@ -1,29 +1,49 @@
 #include "search_server.h"
+#include "shard.h"
+#include "query_frontend.h"
+#include "load_generator.h"
 #include "parse.h"
 #include "test_runner.h"
 #include "profile.h"
 
 #include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iomanip>
 #include <iterator>
 #include <map>
 #include <vector>
 #include <string>
 #include <sstream>
 #include <fstream>
+#include <future>
+#include <mutex>
+#include <new>
 #include <random>
 #include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
 using namespace std;
 using namespace chrono_literals;
 
 void TestFunctionality(
   const vector<string>& docs,
   const vector<string>& queries,
-  const vector<string>& expected
+  const vector<string>& expected,
+  const IndexOptions& options = {}
 ) {
   istringstream docs_input(Join('\n', docs));
   istringstream queries_input(Join('\n', queries));
 
   SearchServer srv;
+  srv.SetIndexOptions(options);
   srv.UpdateDocumentBase(docs_input);
   srv.WaitForAllTasks();
   ostringstream queries_output;
@@ -203,6 +223,1081 @@ void TestBasicSearch() {
   TestFunctionality(docs, queries, expected);
 }
 
+void TestDenseTerms() {
+  vector<string> docs;
+  for (int i = 0; i < 200; ++i) {
+    docs.push_back(i % 7 == 3 ? "the cat and the dog" : "the cat");
+  }
+  docs[150] = "the the the cat cat";
+  docs[190] = "dog";
+
+  const vector<string> queries = {"the", "cat", "the cat", "dog"};
+  const vector<string> expected = {
+    Join(' ', vector{
+      "the:",
+      "{docid: 150, hitcount: 3}",
+      "{docid: 3, hitcount: 2}",
+      "{docid: 10, hitcount: 2}",
+      "{docid: 17, hitcount: 2}",
+      "{docid: 24, hitcount: 2}",
+    }),
+    Join(' ', vector{
+      "cat:",
+      "{docid: 150, hitcount: 2}",
+      "{docid: 0, hitcount: 1}",
+      "{docid: 1, hitcount: 1}",
+      "{docid: 2, hitcount: 1}",
+      "{docid: 3, hitcount: 1}",
+    }),
+    Join(' ', vector{
+      "the cat:",
+      "{docid: 150, hitcount: 5}",
+      "{docid: 3, hitcount: 3}",
+      "{docid: 10, hitcount: 3}",
+      "{docid: 17, hitcount: 3}",
+      "{docid: 24, hitcount: 3}",
+    }),
+    Join(' ', vector{
+      "dog:",
+      "{docid: 3, hitcount: 1}",
+      "{docid: 10, hitcount: 1}",
+      "{docid: 17, hitcount: 1}",
+      "{docid: 24, hitcount: 1}",
+      "{docid: 31, hitcount: 1}",
+    }),
+  };
+  TestFunctionality(docs, queries, expected);
+
+  // One (docid, hits) entry per document a term occurs in, without bitmaps
+  size_t entries = 0;
+  for (const auto& doc : docs) {
+    auto words = SplitIntoWordsView(doc);
+    sort(words.begin(), words.end());
+    entries += unique(words.begin(), words.end()) - words.begin();
+  }
+  const InvertedIndex index(deque<string>(docs.begin(), docs.end()));
+  ASSERT(index.MemoryUsage().postings < entries * sizeof(DocHits::value_type));
+}
+
+void TestShardedSearch() {
+  vector<string> docs;
+  for (int i = 0; i < 40; ++i) {
+    ostringstream doc;
+    doc << "doc" << i % 9 << " is number " << i;
+    for (int j = 0; j < i % 4; ++j) {
+      doc << " again doc" << i % 9;
+    }
+    docs.push_back(doc.str());
+  }
+  const vector<string> queries = {
+    "doc1", "is", "again", "doc3 again", "number 7 doc7", "missing", "is doc5 again"
+  };
+
+  istringstream docs_input(Join('\n', docs));
+  istringstream queries_input(Join('\n', queries));
+  SearchServer srv(docs_input);
+  srv.WaitForAllTasks();
+  ostringstream expected;
+  srv.AddQueriesStream(queries_input, expected);
+  srv.WaitForAllTasks();
+
+  auto start_shard = [&docs](const string& socket, size_t first_docid, size_t docs_count) {
+    const pid_t pid = fork();
+    ASSERT(pid >= 0);
+    if (pid == 0) {
+      // Nothing may unwind into the child's copy of the test runner
+      int exit_code = 0;
+      try {
+        istringstream shard_input(Join('\n', docs));
+        ShardWorker(shard_input, first_docid, docs_count).Serve(socket);
+      } catch (exception& e) {
+        cerr << "shard worker: " << e.what() << endl;
+        exit_code = 1;
+      } catch (...) {
+        exit_code = 1;
+      }
+      _exit(exit_code);
+    }
+    return pid;
+  };
+
+  const size_t shard_docs[] = {13, 14, 13};
+  const string socket_prefix = "/tmp/redfinal_shard_" + to_string(getpid()) + "_";
+  vector<string> sockets;
+  vector<pid_t> workers;
+  size_t first_docid = 0;
+  for (size_t docs_count : shard_docs) {
+    sockets.push_back(socket_prefix + to_string(sockets.size()));
+    workers.push_back(start_shard(sockets.back(), first_docid, docs_count));
+    first_docid += docs_count;
+  }
+
+  ostringstream result;
+  {
+    ShardCoordinator coordinator(sockets);
+    istringstream sharded_queries(Join('\n', queries));
+    coordinator.AddQueriesStream(sharded_queries, result);
+    coordinator.ShutdownShards();
+  }
+  for (pid_t pid : workers) {
+    int status = 0;
+    waitpid(pid, &status, 0);
+    ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  }
+  ASSERT_EQUAL(result.str(), expected.str());
+
+  // A shard that died is reported, not a SIGPIPE for the coordinator
+  const string dead_socket = socket_prefix + "dead";
+  const pid_t dead = start_shard(dead_socket, 0, docs.size());
+  ShardCoordinator coordinator({dead_socket});
+  kill(dead, SIGKILL);
+  waitpid(dead, nullptr, 0);
+  unlink(dead_socket.c_str());
+  string error;
+  try {
+    istringstream dead_queries("doc1\ndoc2\n");
+    ostringstream dead_output;
+    coordinator.AddQueriesStream(dead_queries, dead_output);
+  } catch (runtime_error& e) {
+    error = e.what();
+  }
+  ASSERT_EQUAL(error, "shard closed the connection");
+}
+
+string ExchangeOverSocket(int fd, const string& request) {
+  ASSERT(fd >= 0);
+  for (size_t sent = 0; sent < request.size(); ) {
+    ssize_t written = write(fd, request.data() + sent, request.size() - sent);
+    ASSERT(written > 0);
+    sent += written;
+  }
+  shutdown(fd, SHUT_WR);
+  string response;
+  char buffer[4096];
+  for (ssize_t got; (got = read(fd, buffer, sizeof(buffer))) > 0; ) {
+    response.append(buffer, got);
+  }
+  close(fd);
+  return response;
+}
+
+void TestQueryFrontend() {
+  const vector<string> docs = {
+    "london is the capital of great britain",
+    "paris is the capital of france",
+    "moscow is the capital of russia",
+    "welcome to moscow the capital of russia the third rome",
+    "i am travelling down the river",
+  };
+  const vector<string> queries = {
+    "london", "the", "moscow is the capital of russia", "rome", "nothing", "river is"
+  };
+
+  istringstream docs_input(Join('\n', docs));
+  SearchServer srv(docs_input);
+  srv.WaitForAllTasks();
+  istringstream queries_input(Join('\n', queries));
+  ostringstream expected;
+  srv.AddQueriesStream(queries_input, expected);
+  srv.WaitForAllTasks();
+
+  QueryFrontend frontend(srv);
+  const string socket_path = "/tmp/redfinal_frontend_" + to_string(getpid());
+  frontend.ListenUnix(socket_path);
+  const uint16_t port = frontend.ListenTcp("127.0.0.1", 0);
+  thread loop([&frontend] { frontend.Run(); });
+
+  // Pipelined queries, CRLF line ends and a last line without newline
+  const string request = Join('\n', queries) + "\n\n" + Join('\n', queries) + "\r\n" + queries[0];
+  const string repeated = expected.str() + expected.str()
+      + expected.str().substr(0, expected.str().find('\n') + 1);
+
+  vector<future<string>> clients;
+  for (int i = 0; i < 8; ++i) {
+    clients.push_back(async(launch::async, [&, i] {
+      if (i % 2 == 0) {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address));
+        return ExchangeOverSocket(fd, request);
+      }
+      sockaddr_in address{};
+      address.sin_family = AF_INET;
+      address.sin_port = htons(port);
+      inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+      int fd = socket(AF_INET, SOCK_STREAM, 0);
+      connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address));
+      return ExchangeOverSocket(fd, request);
+    }));
+  }
+  vector<string> responses;
+  for (auto& client : clients) {
+    responses.push_back(client.get());
+  }
+
+  // Far more lines in one read than replies may be pending: the rest wait
+  // in the input buffer and are all answered in order
+  string burst;
+  string burst_expected;
+  for (int i = 0; i < 50; ++i) {
+    burst += Join('\n', queries) + '\n';
+    burst_expected += expected.str();
+  }
+  {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address));
+    ASSERT_EQUAL(ExchangeOverSocket(fd, burst), burst_expected);
+  }
+  frontend.Stop();
+  loop.join();
+
+  for (const auto& response : responses) {
+    ASSERT_EQUAL(response, repeated);
+  }
+}
+
+void TestCompactDictionary() {
+  vector<string> docs;
+  for (int i = 0; i < 300; ++i) {
+    ostringstream doc;
+    doc << "term" << i * 7919 % 1000 << " shared term" << i % 13;
+    if (i % 5 == 0) {
+      doc << " capital capitals capitol";
+    }
+    docs.push_back(doc.str());
+  }
+  const vector<string> queries = {
+    "term0", "term13 term500", "shared", "capital", "capitals", "capit*", "capitol*",
+    "term99*", "t*", "zzz", "a", "term", "term1000", "*"
+  };
+
+  istringstream docs_input(Join('\n', docs));
+  istringstream queries_input(Join('\n', queries));
+  SearchServer srv(docs_input);
+  srv.WaitForAllTasks();
+  ostringstream expected;
+  srv.AddQueriesStream(queries_input, expected);
+  srv.WaitForAllTasks();
+
+  IndexOptions options;
+  options.dictionary = TermDictionaryType::Compact;
+  const string expected_text = expected.str();
+  const auto lines = SplitBy(Strip(expected_text), '\n');
+  TestFunctionality(docs, queries, {lines.begin(), lines.end()}, options);
+}
+
+void TestContiguousPostings() {
+  vector<string> docs;
+  for (int i = 0; i < 300; ++i) {
+    ostringstream doc;
+    doc << "term" << i * 7919 % 1000 << " shared term" << i % 13 << " shared";
+    if (i % 5 == 0) {
+      doc << " capital capitals capitol term" << i % 13;
+    }
+    docs.push_back(doc.str());
+  }
+  const vector<string> queries = {
+    "term0", "term13 term500", "shared", "capital", "capit*", "term1*", "zzz", "shared term3"
+  };
+
+  istringstream docs_input(Join('\n', docs));
+  istringstream queries_input(Join('\n', queries));
+  SearchServer srv(docs_input);
+  srv.WaitForAllTasks();
+  ostringstream expected;
+  srv.AddQueriesStream(queries_input, expected);
+  srv.WaitForAllTasks();
+
+  const string expected_text = expected.str();
+  const auto lines = SplitBy(Strip(expected_text), '\n');
+  for (auto dictionary : {TermDictionaryType::Tree, TermDictionaryType::Compact}) {
+    IndexOptions options;
+    options.dictionary = dictionary;
+    options.postings = PostingsLayout::Contiguous;
+    TestFunctionality(docs, queries, {lines.begin(), lines.end()}, options);
+  }
+
+  IndexOptions options;
+  options.postings = PostingsLayout::Contiguous;
+  const InvertedIndex per_term({docs.begin(), docs.end()});
+  const InvertedIndex contiguous({docs.begin(), docs.end()}, options);
+  for (string_view word : {"shared", "term7", "capit*", "zzz"}) {
+    ASSERT_EQUAL_HINT(contiguous.PostingsLength(word), per_term.PostingsLength(word), string(word));
+  }
+  const auto usage = contiguous.MemoryUsage();
+  ASSERT_EQUAL(usage.slack, 0u);
+  ASSERT(usage.postings < per_term.MemoryUsage().postings);
+}
+
+void TestBlockCompression() {
+  string random_text;
+  mt19937 gen(3);
+  for (int i = 0; i < 100000; ++i) {
+    random_text.push_back(char(gen()));
+  }
+  const vector<string> inputs = {
+    "", "a", "abc", "abcd", "abcdabcd", string(100000, 'x'),
+    "the cat and the dog and the cat and the dog", random_text
+  };
+  for (const auto& input : inputs) {
+    string compressed;
+    CompressBlock(input, compressed);
+    string output;
+    DecompressBlock(compressed, input.size(), output);
+    ASSERT_EQUAL_HINT(output == input, true, to_string(input.size()));
+    // As LZ4 requires, the block ends with at least 5 literals
+    const size_t tail = min<size_t>(input.size(), 5);
+    ASSERT(compressed.compare(compressed.size() - tail, tail, input, input.size() - tail, tail) == 0);
+  }
+  string compressed;
+  CompressBlock(string(1000, 'x'), compressed);
+  ASSERT(compressed.size() < 20);
+}
+
+void TestDocumentStore() {
+  deque<string> docs;
+  for (int i = 0; i < 3000; ++i) {
+    docs.push_back("document " + to_string(i) + " about the capital of great britain and "
+                   + (i % 3 ? "the river thames" : "the big ben tower") + " w" + to_string(i % 97));
+  }
+  const vector<string> queries = {"capital", "w5", "document 17", "ben w1", "river*", "missing"};
+  istringstream queries_input(Join('\n', queries));
+  istringstream docs_input(Join('\n', docs));
+  SearchServer srv(docs_input);
+  srv.WaitForAllTasks();
+  ostringstream expected;
+  srv.AddQueriesStream(queries_input, expected);
+  srv.WaitForAllTasks();
+  const string expected_text = expected.str();
+  const auto lines = SplitBy(Strip(expected_text), '\n');
+  const vector<string> docs_list(docs.begin(), docs.end());
+
+  IndexOptions options;
+  const InvertedIndex kept(docs, options);
+  options.documents = DocumentStore::Compressed;
+  const InvertedIndex compressed(docs, options);
+  options.documents = DocumentStore::Discard;
+  const InvertedIndex discarded(docs, options);
+
+  for (auto store : {DocumentStore::Compressed, DocumentStore::Discard}) {
+    for (auto dictionary : {TermDictionaryType::Tree, TermDictionaryType::Compact}) {
+      IndexOptions options;
+      options.documents = store;
+      options.dictionary = dictionary;
+      TestFunctionality(docs_list, queries, {lines.begin(), lines.end()}, options);
+      // Terms few and short enough to fit a string's inline storage
+      TestFunctionality({"xy zw", "xy"}, {"xy", "zw"},
+                        {"xy: {docid: 0, hitcount: 1} {docid: 1, hitcount: 1}",
+                         "zw: {docid: 0, hitcount: 1}"}, options);
+    }
+  }
+
+  ASSERT_EQUAL(compressed.DocsCount(), docs.size());
+  ASSERT_EQUAL(discarded.DocsCount(), docs.size());
+  for (size_t id = 0; id < docs.size(); ++id) {
+    ASSERT_EQUAL(compressed.GetDocument(id), docs[id]);
+  }
+  ASSERT_EQUAL(kept.GetDocument(42), docs[42]);
+  bool thrown = false;
+  try {
+    discarded.GetDocument(0);
+  } catch (logic_error&) {
+    thrown = true;
+  }
+  ASSERT(thrown);
+
+  const auto kept_usage = kept.MemoryUsage();
+  ASSERT(compressed.MemoryUsage().documents * 2 < kept_usage.documents);
+  ASSERT_EQUAL(discarded.MemoryUsage().documents, 0u);
+  ASSERT(discarded.MemoryUsage().Total() < kept_usage.Total());
+}
+
+void TestPrefixQuery() {
+  vector<string> docs;
+  for (int i = 0; i < 200; ++i) {
+    ostringstream doc;
+    doc << 'w' << setw(3) << setfill('0') << 199 - i;
+    docs.push_back(doc.str());
+  }
+  docs[10] += " capital capitol capitals";
+  docs[20] += " capital capital";
+  docs[30] += " captain";
+
+  // w000..w127 are the first terms with prefix "w", they occur in docs 199..72
+  const vector<string> queries = {"capit*", "capital*", "cap* w189", "w*", "w00*", "x*"};
+  const vector<string> expected = {
+    Join(' ', vector{
+      "capit*:",
+      "{docid: 10, hitcount: 3}",
+      "{docid: 20, hitcount: 2}",
+    }),
+    Join(' ', vector{
+      "capital*:",
+      "{docid: 10, hitcount: 2}",
+      "{docid: 20, hitcount: 2}",
+    }),
+    Join(' ', vector{
+      "cap* w189:",
+      "{docid: 10, hitcount: 4}",
+      "{docid: 20, hitcount: 2}",
+      "{docid: 30, hitcount: 1}",
+    }),
+    Join(' ', vector{
+      "w*:",
+      "{docid: 72, hitcount: 1}",
+      "{docid: 73, hitcount: 1}",
+      "{docid: 74, hitcount: 1}",
+      "{docid: 75, hitcount: 1}",
+      "{docid: 76, hitcount: 1}",
+    }),
+    Join(' ', vector{
+      "w00*:",
+      "{docid: 190, hitcount: 1}",
+      "{docid: 191, hitcount: 1}",
+      "{docid: 192, hitcount: 1}",
+      "{docid: 193, hitcount: 1}",
+      "{docid: 194, hitcount: 1}",
+    }),
+    "x*:",
+  };
+  TestFunctionality(docs, queries, expected);
+
+  IndexOptions options;
+  options.dictionary = TermDictionaryType::Compact;
+  TestFunctionality(docs, queries, expected, options);
+}
+
+void TestTopKSelection() {
+  mt19937 gen(11);
+  uniform_int_distribution<size_t> hits(0, 6);
+  vector<size_t> docHits(2000);
+  for (auto& h : docHits) {
+    h = hits(gen);
+  }
+  DocHits reference;
+  for (size_t doc = 0; doc < docHits.size(); ++doc) {
+    if (docHits[doc] > 0) {
+      reference.emplace_back(doc + 100, docHits[doc]);
+    }
+  }
+  sort(reference.begin(), reference.end(), RanksBefore);
+
+  for (size_t k : {0, 1, 2, 5, 8, 9, 50, 1000, 5000}) {
+    const size_t expected_size = min(k, reference.size());
+    const DocHits expected(reference.begin(), reference.begin() + expected_size);
+    DocHits selected;
+    SelectTop(docHits, k, 100, selected);
+    ASSERT_EQUAL_HINT(selected == expected, true, "k = " + to_string(k));
+    SelectTopHeap(docHits, k, 100, selected);
+    ASSERT_EQUAL_HINT(selected == expected, true, "heap, k = " + to_string(k));
+
+    SearchResult pushed(k);
+    for (auto item : reference) {
+      pushed.PushBack(move(item));
+    }
+    ASSERT_EQUAL_HINT(DocHits(pushed.begin(), pushed.end()) == expected, true,
+                      "PushBack, k = " + to_string(k));
+  }
+}
+
+void TestResultPaging() {
+  vector<string> docs;
+  for (int i = 0; i < 30; ++i) {
+    docs.push_back(Join(' ', vector<string>(i % 10 + 1, "word")));
+  }
+  istringstream docs_input(Join('\n', docs));
+  SearchServer srv(docs_input);
+  srv.WaitForAllTasks();
+
+  ostringstream page_output;
+  srv.AnswerQuery("word", page_output, {4, 3});
+  ASSERT_EQUAL(page_output.str(), "word: {docid: 18, hitcount: 9} {docid: 28, hitcount: 9} "
+                                  "{docid: 7, hitcount: 8}\n");
+
+  ostringstream past_end;
+  srv.AnswerQuery("word", past_end, {30, 5});
+  ASSERT_EQUAL(past_end.str(), "word:\n");
+
+  ostringstream all_after;
+  srv.AnswerQuery("word", all_after, {27, SIZE_MAX});
+  ASSERT_EQUAL(all_after.str(), "word: {docid: 0, hitcount: 1} {docid: 10, hitcount: 1} "
+                                "{docid: 20, hitcount: 1}\n");
+
+  srv.SetResultPage({0, 12});
+  ostringstream top12;
+  srv.AnswerQuery("word", top12);
+  ASSERT_EQUAL(SplitIntoWordsView(top12.str()).size(), 1u + 12 * 4);
+
+  istringstream stream_input("word\nword word\n");
+  ostringstream stream_output;
+  StreamOptions options;
+  options.page = ResultPage{1, 1};
+  srv.AddQueriesStream(stream_input, stream_output, options);
+  istringstream default_input("word\n");
+  ostringstream default_output;
+  srv.AddQueriesStream(default_input, default_output);
+  srv.WaitForAllTasks();
+  ASSERT_EQUAL(stream_output.str(), "word: {docid: 19, hitcount: 10}\n"
+                                    "word word: {docid: 19, hitcount: 20}\n");
+  ASSERT_EQUAL(default_output.str(), top12.str());
+}
+
+void TestPairCache() {
+  vector<string> docs;
+  for (int i = 0; i < 500; ++i) {
+    docs.push_back("doc" + to_string(i % 37) + " word" + to_string(i % 5) + " word" + to_string(i % 7)
+                   + (i % 3 ? " common" : " rare"));
+  }
+  const string docs_text = Join('\n', docs);
+  const vector<string> queries = {
+    "word1 word2", "word2 word1 word1", "common word3 doc5", "word1 word2 word1*", "rare common",
+    "word4", "doc7 doc7 word1 common"
+  };
+  string queries_text;
+  for (int round = 0; round < 10; ++round) {
+    queries_text += Join('\n', queries) + '\n';
+  }
+
+  auto run = [&](SearchServer& srv) {
+    istringstream queries_input(queries_text);
+    ostringstream output;
+    srv.AddQueriesStream(queries_input, output);
+    srv.WaitForAllTasks();
+    return output.str();
+  };
+
+  istringstream plain_docs(docs_text);
+  SearchServer plain(plain_docs);
+  plain.WaitForAllTasks();
+  const string expected = run(plain);
+  ASSERT_EQUAL(plain.GetPairCacheStats().hits, 0u);
+
+  istringstream cached_docs(docs_text);
+  SearchServer cached(cached_docs);
+  cached.WaitForAllTasks();
+  cached.SetPairCacheBudget(1 << 20);
+  ASSERT_EQUAL(run(cached), expected);
+  auto stats = cached.GetPairCacheStats();
+  ASSERT(stats.merged_pairs > 0);
+  ASSERT(stats.hits > 0);
+  ASSERT(stats.bytes <= (1u << 20));
+
+  // The merged lists follow the index to its next version, merged by the
+  // update rather than by the first queries
+  istringstream new_docs(docs_text + "\nword1 word2 common");
+  cached.UpdateDocumentBase(new_docs);
+  istringstream new_plain_docs(docs_text + "\nword1 word2 common");
+  plain.UpdateDocumentBase(new_plain_docs);
+  cached.WaitForAllTasks();
+  plain.WaitForAllTasks();
+  ASSERT_EQUAL(cached.GetPairCacheStats().merged_pairs, stats.merged_pairs);
+  ASSERT_EQUAL(run(cached), run(plain));
+  ASSERT(cached.GetPairCacheStats().hits > stats.hits);
+
+  // A budget too small for any list: nothing is merged, answers stay right
+  cached.SetPairCacheBudget(16);
+  ASSERT_EQUAL(cached.GetPairCacheStats().merged_pairs, 0u);
+  stats = cached.GetPairCacheStats();
+  ASSERT_EQUAL(run(cached), run(plain));
+  ASSERT_EQUAL(cached.GetPairCacheStats().hits, stats.hits);
+}
+
+void TestQueryPlanner() {
+  vector<string> docs;
+  for (int i = 0; i < 400; ++i) {
+    docs.push_back("is doc" + to_string(i % 23) + " word" + to_string(i % 4) + " is"
+                   + (i % 50 ? "" : " rare rarer"));
+  }
+  IndexOptions contiguous;
+  contiguous.postings = PostingsLayout::Contiguous;
+  for (const auto& options : {IndexOptions{}, contiguous}) {
+    const InvertedIndex index({docs.begin(), docs.end()}, options);
+
+    const auto plan = index.PlanQuery({"is", "rare*", "is", "missing", "word1", "is", "is"});
+    ASSERT_EQUAL(plan.size(), 3u);
+    ASSERT_EQUAL(plan[0].word, "rare*");
+    ASSERT_EQUAL(plan[0].multiplicity, 1u);
+    ASSERT_EQUAL(plan[0].postings, 16u);
+    ASSERT_EQUAL(plan[1].word, "word1");
+    ASSERT_EQUAL(plan[1].postings, 100u);
+    ASSERT_EQUAL(plan[2].word, "is");
+    ASSERT_EQUAL(plan[2].multiplicity, 4u);
+    ASSERT_EQUAL(plan[2].postings, 400u);
+
+    for (string_view query : {"is is is is", "doc3 word2 doc3 rare", "r* is doc1*", "", "missing"}) {
+      const auto words = SplitIntoWordsView(query);
+      vector<size_t> expected(index.DocsCount());
+      for (auto word : words) {
+        index.LookupAndSum(word, expected);
+      }
+      vector<size_t> planned(index.DocsCount());
+      index.SumPlan(index.PlanQuery(words), planned);
+      ASSERT_EQUAL_HINT(planned == expected, true, string(query));
+    }
+  }
+}
+
+void TestExplain() {
+  const vector<string> docs = {
+    "london is the capital of great britain",
+    "paris is the capital of france",
+    "the the the",
+  };
+  istringstream docs_input(Join('\n', docs));
+  SearchServer srv(docs_input);
+  srv.WaitForAllTasks();
+
+  ostringstream explain;
+  srv.SetExplainOutput(&explain);
+  istringstream queries_input("the capital\nrome\nca* london");
+  ostringstream output;
+  srv.AddQueriesStream(queries_input, output);
+  srv.WaitForAllTasks();
+
+  const string explain_text = explain.str();
+  const auto lines = SplitBy(Strip(explain_text), '\n');
+  ASSERT_EQUAL(lines.size(), 3u);
+  ASSERT(lines[0].substr(0, 33) == "the capital: index_version: 1, to");
+  ASSERT(lines[0].find("docs_touched: 3, postings: {the: 3, capital: 2}") != string_view::npos);
+  ASSERT(lines[1].find("docs_touched: 0, postings: {rome: 0}") != string_view::npos);
+  ASSERT(lines[2].find("docs_touched: 2, postings: {ca*: 2, london: 1}") != string_view::npos);
+
+  istringstream new_docs("rome is the capital of italy");
+  srv.UpdateDocumentBase(new_docs);
+  srv.WaitForAllTasks();
+  ostringstream sampled;
+  srv.SetExplainOutput(&sampled, 2);
+  istringstream more_queries("rome\nitaly\nis\nof");
+  srv.AddQueriesStream(more_queries, output);
+  srv.WaitForAllTasks();
+  const string sampled_text = sampled.str();
+  const auto sampled_lines = SplitBy(Strip(sampled_text), '\n');
+  ASSERT_EQUAL(sampled_lines.size(), 2u);
+  ASSERT(sampled_lines[0].find("index_version: 2") != string_view::npos);
+
+  srv.SetExplainOutput(nullptr);
+  istringstream last_query("rome");
+  srv.AddQueriesStream(last_query, output);
+  srv.WaitForAllTasks();
+  ASSERT_EQUAL(sampled.str(), sampled_text);
+}
+
+void TestQueryPipeline() {
+  vector<string> docs;
+  for (int i = 0; i < 100; ++i) {
+    docs.push_back("doc" + to_string(i % 17) + " word" + to_string(i % 5) + " word" + to_string(i % 3));
+  }
+  vector<string> queries;
+  for (int i = 0; i < 500; ++i) {
+    queries.push_back("word" + to_string(i % 7) + " doc" + to_string(i % 19));
+  }
+
+  istringstream docs_input(Join('\n', docs));
+  SearchServer srv(docs_input);
+  srv.WaitForAllTasks();
+
+  ostringstream expected;
+  for (const auto& query : queries) {
+    srv.AnswerQuery(query, expected);
+  }
+
+  const size_t STREAMS = 24;
+  vector<istringstream> inputs;
+  vector<ostringstream> outputs(STREAMS);
+  for (size_t i = 0; i < STREAMS; ++i) {
+    inputs.emplace_back(Join('\n', queries) + "\n\n");
+  }
+  for (size_t i = 0; i < STREAMS; ++i) {
+    srv.AddQueriesStream(inputs[i], outputs[i]);
+  }
+  srv.WaitForAllTasks();
+
+  for (const auto& output : outputs) {
+    ASSERT_EQUAL(output.str(), expected.str());
+  }
+  for (auto stage : {QueryStage::Read, QueryStage::Parse, QueryStage::Lookup,
+                     QueryStage::Rank, QueryStage::Format}) {
+    ASSERT_EQUAL_HINT(srv.GetStageStats(stage).queries, STREAMS * queries.size(),
+                      QueryStageName(stage));
+  }
+}
+
+void TestPriorityScheduler() {
+  PriorityScheduler scheduler(1);
+  mutex m;
+  condition_variable cv;
+  bool release = false;
+  vector<string> order;
+
+  // Holds the only worker until every other task is queued
+  scheduler.Post([&] {
+    unique_lock<mutex> lock(m);
+    cv.wait(lock, [&] { return release; });
+  }, 0, PriorityScheduler::Clock::time_point::max());
+
+  const auto now = PriorityScheduler::Clock::now();
+  auto record = [&](string name) {
+    return [&, name] {
+      lock_guard<mutex> lock(m);
+      order.push_back(name);
+    };
+  };
+  scheduler.Post(record("bulk"), 0, PriorityScheduler::Clock::time_point::max());
+  scheduler.Post(record("late"), 1, now + 2s);
+  scheduler.Post(record("soon"), 1, now + 1s);
+  scheduler.Post(record("urgent"), 2, PriorityScheduler::Clock::time_point::max());
+  scheduler.Post(record("bulk2"), 0, PriorityScheduler::Clock::time_point::max());
+
+  promise<void> done;
+  scheduler.Post([&] { done.set_value(); }, -1, PriorityScheduler::Clock::time_point::max());
+  {
+    lock_guard<mutex> lock(m);
+    release = true;
+  }
+  cv.notify_one();
+  done.get_future().wait();
+
+  const vector<string> expected = {"urgent", "soon", "late", "bulk", "bulk2"};
+  ASSERT_EQUAL(order, expected);
+}
+
+void TestCpuQuota() {
+  PriorityScheduler scheduler(4);
+  CpuQuota quota(scheduler);
+  quota.SetLimit(1);
+  mutex m;
+  condition_variable cv;
+  bool release = false;
+  size_t running = 0;
+  size_t max_running = 0;
+  vector<string> order;
+
+  // Holds the quota's only slot while the others are posted
+  quota.Post([&] {
+    unique_lock<mutex> lock(m);
+    cv.wait(lock, [&] { return release; });
+  }, 0, PriorityScheduler::Clock::time_point::max());
+
+  promise<void> done;
+  size_t left = 6;
+  auto record = [&](string name) {
+    return [&, name] {
+      {
+        lock_guard<mutex> lock(m);
+        max_running = max(max_running, ++running);
+        order.push_back(name);
+      }
+      this_thread::sleep_for(1ms);
+      lock_guard<mutex> lock(m);
+      --running;
+      if (--left == 0)
+        done.set_value();
+    };
+  };
+  for (int i = 0; i < 4; ++i) {
+    quota.Post(record("bulk"), 0, PriorityScheduler::Clock::time_point::max());
+  }
+  quota.Post(record("urgent"), 1, PriorityScheduler::Clock::time_point::max());
+  quota.Post(record("bulk"), 0, PriorityScheduler::Clock::time_point::max());
+  {
+    lock_guard<mutex> lock(m);
+    release = true;
+  }
+  cv.notify_one();
+  done.get_future().wait();
+
+  ASSERT_EQUAL(max_running, 1u);
+  ASSERT_EQUAL(order.front(), "urgent");
+}
+
+void TestStreamDeadlines() {
+  istringstream docs_input("london paris\nparis rome\nrome");
+  SearchServer srv(docs_input);
+  srv.WaitForAllTasks();
+
+  const string queries = "paris\nrome\nlondon\n";
+  ostringstream expected;
+  for (string_view query : {"paris", "rome", "london"}) {
+    srv.AnswerQuery(query, expected);
+  }
+
+  istringstream relaxed_input(queries);
+  ostringstream relaxed_output;
+  StreamOptions relaxed;
+  relaxed.priority = 1;
+  relaxed.deadline = 1h;
+  srv.AddQueriesStream(relaxed_input, relaxed_output, relaxed);
+  srv.WaitForAllTasks();
+  ASSERT_EQUAL(relaxed_output.str(), expected.str());
+  ASSERT_EQUAL(srv.GetDeadlineMisses(), 0u);
+
+  // A nanosecond is always over by the time the answer is written
+  istringstream marked_input(queries);
+  ostringstream marked_output;
+  StreamOptions marked;
+  marked.deadline = 1ns;
+  srv.AddQueriesStream(marked_input, marked_output, marked);
+  srv.WaitForAllTasks();
+  ASSERT_EQUAL(marked_output.str(),
+               "paris: {docid: 0, hitcount: 1} {docid: 1, hitcount: 1} [deadline missed]\n"
+               "rome: {docid: 1, hitcount: 1} {docid: 2, hitcount: 1} [deadline missed]\n"
+               "london: {docid: 0, hitcount: 1} [deadline missed]\n");
+  ASSERT_EQUAL(srv.GetDeadlineMisses(), 3u);
+
+  istringstream dropped_input(queries);
+  ostringstream dropped_output;
+  StreamOptions dropped;
+  dropped.deadline = 1ns;
+  dropped.on_deadline_miss = DeadlineMissPolicy::Drop;
+  srv.AddQueriesStream(dropped_input, dropped_output, dropped);
+  srv.WaitForAllTasks();
+  ASSERT_EQUAL(dropped_output.str(), "");
+  ASSERT_EQUAL(srv.GetDeadlineMisses(), 6u);
+}
+
+void TestMemoryBudget() {
+  vector<string> docs;
+  for (int i = 0; i < 1000; ++i) {
+    docs.push_back("the document number " + to_string(i) + " of the base with word" + to_string(i % 50));
+  }
+  const string docs_text = Join('\n', docs);
+
+  SearchServer srv;
+  {
+    istringstream docs_input(docs_text);
+    srv.UpdateDocumentBase(docs_input);
+    srv.WaitForAllTasks();
+  }
+  const auto usage = srv.GetIndexMemoryUsage();
+  ASSERT(usage.documents >= docs_text.size() - docs.size());
+  ASSERT(usage.dictionary > 0);
+  ASSERT(usage.postings > 0);
+  ASSERT(usage.slack > 0);
+  ASSERT(usage.slack < usage.Total());
+
+  // Enough for one index but not for two: the rebuild still succeeds
+  srv.SetMemoryBudget(usage.Total() * 3 / 2 + 4096);
+  {
+    istringstream docs_input(docs_text);
+    srv.UpdateDocumentBase(docs_input);
+    srv.WaitForAllTasks();
+  }
+  ostringstream output;
+  srv.AnswerQuery("word7", output);
+  ASSERT_EQUAL(output.str(), "word7: {docid: 7, hitcount: 1} {docid: 57, hitcount: 1} "
+                             "{docid: 107, hitcount: 1} {docid: 157, hitcount: 1} "
+                             "{docid: 207, hitcount: 1}\n");
+
+  // Too small for any index: the update fails and the old index stays
+  srv.SetMemoryBudget(usage.Total() / 4);
+  istringstream other_docs(docs_text + "\nsomething else entirely");
+  srv.UpdateDocumentBase(other_docs);
+  bool refused = false;
+  try {
+    srv.WaitForAllTasks();
+  } catch (MemoryBudgetExceeded&) {
+    refused = true;
+  }
+  ASSERT(refused);
+  ostringstream after;
+  srv.AnswerQuery("word7", after);
+  ASSERT_EQUAL(after.str(), output.str());
+
+  // A build that fails after the current index was dropped leaves the
+  // index empty, and its answers say so, until the next update succeeds
+  srv.SetMemoryBudget(usage.Total() * 3 / 2 + 4096);
+  IndexOptions failing;
+  failing.before_build = [] { throw bad_alloc(); };
+  srv.SetIndexOptions(failing);
+  {
+    istringstream docs_input(docs_text);
+    srv.UpdateDocumentBase(docs_input);
+    bool failed = false;
+    try {
+      srv.WaitForAllTasks();
+    } catch (bad_alloc&) {
+      failed = true;
+    }
+    ASSERT(failed);
+  }
+  ostringstream emptied;
+  srv.AnswerQuery("word7", emptied);
+  ASSERT_EQUAL(emptied.str(), "word7: [index build failed]\n");
+  srv.SetIndexOptions({});
+  // The empty index has no build cost to extrapolate from and would refuse
+  // the retry on its pessimistic guess; without a budget none is made
+  srv.SetMemoryBudget(0);
+  {
+    istringstream docs_input(docs_text);
+    srv.UpdateDocumentBase(docs_input);
+    srv.WaitForAllTasks();
+  }
+  ostringstream restored;
+  srv.AnswerQuery("word7", restored);
+  ASSERT_EQUAL(restored.str(), output.str());
+
+  // While a dropped index is rebuilt, queries are answered from an empty
+  // one instead of waiting for the build
+  srv.SetMemoryBudget(usage.Total() * 3 / 2 + 4096);
+  promise<void> started;
+  promise<void> resume;
+  shared_future<void> resumed = resume.get_future().share();
+  IndexOptions held;
+  held.before_build = [&started, resumed] {
+    started.set_value();
+    resumed.wait();
+  };
+  srv.SetIndexOptions(held);
+  {
+    istringstream docs_input(docs_text);
+    srv.UpdateDocumentBase(docs_input);
+    started.get_future().wait();
+    ostringstream rebuilding;
+    srv.AnswerQuery("word7", rebuilding);
+    ASSERT_EQUAL(rebuilding.str(), "word7: [index rebuilding]\n");
+    resume.set_value();
+    srv.WaitForAllTasks();
+  }
+  ostringstream rebuilt;
+  srv.AnswerQuery("word7", rebuilt);
+  ASSERT_EQUAL(rebuilt.str(), output.str());
+}
+
+void TestMultipleIndexes() {
+  SearchServer srv;
+  srv.CreateIndex("animals");
+  srv.CreateIndex("cities");
+  bool duplicate = false;
+  try {
+    srv.CreateIndex("cities");
+  } catch (invalid_argument&) {
+    duplicate = true;
+  }
+  ASSERT(duplicate);
+  const vector<string> names = {"", "animals", "cities"};
+  ASSERT_EQUAL(srv.GetIndexNames(), names);
+
+  IndexOptions contiguous;
+  contiguous.postings = PostingsLayout::Contiguous;
+  istringstream animals("cat dog\ndog\nfox");
+  istringstream cities("paris\nrome paris");
+  srv.UpdateDocumentBase("animals", animals);
+
+  // Building does not hold the index: its queries, and the workers serving
+  // them, go on while the first build of the cities is held
+  promise<void> started;
+  promise<void> resume;
+  shared_future<void> resumed = resume.get_future().share();
+  contiguous.before_build = [&started, resumed] {
+    started.set_value();
+    resumed.wait();
+  };
+  srv.SetIndexOptions("cities", contiguous);
+  srv.UpdateDocumentBase("cities", cities);
+  started.get_future().wait();
+  ostringstream during_build;
+  srv.AnswerQuery("cities", "paris", during_build, {});
+  ASSERT_EQUAL(during_build.str(), "paris:\n");
+  resume.set_value();
+  srv.WaitForAllTasks();
+
+  // One worker at most for the animals, whatever the number of workers
+  srv.SetCpuQuota("animals", 0.01);
+  istringstream animal_queries("dog\nparis\n");
+  istringstream city_queries("dog\nparis\n");
+  ostringstream animal_output;
+  ostringstream city_output;
+  srv.AddQueriesStream("animals", animal_queries, animal_output);
+  srv.AddQueriesStream("cities", city_queries, city_output);
+  srv.WaitForAllTasks();
+  ASSERT_EQUAL(animal_output.str(), "dog: {docid: 0, hitcount: 1} {docid: 1, hitcount: 1}\nparis:\n");
+  ASSERT_EQUAL(city_output.str(), "dog:\nparis: {docid: 0, hitcount: 1} {docid: 1, hitcount: 1}\n");
+
+  ostringstream default_output;
+  srv.AnswerQuery("dog", default_output);
+  ASSERT_EQUAL(default_output.str(), "dog:\n");
+
+  ASSERT_EQUAL(srv.GetStageStats("animals", QueryStage::Format).queries, 2u);
+  ASSERT_EQUAL(srv.GetStageStats(QueryStage::Format).queries, 4u);
+
+  bool unknown = false;
+  try {
+    istringstream input("dog");
+    ostringstream output;
+    srv.AddQueriesStream("plants", input, output);
+  } catch (out_of_range&) {
+    unknown = true;
+  }
+  ASSERT(unknown);
+
+  // The budget covers all indexes: the cities leave no room for the animals
+  srv.SetMemoryBudget(srv.GetIndexMemoryUsage("cities").Total());
+  istringstream more_animals("cat dog\ndog\nfox\nowl");
+  srv.UpdateDocumentBase("animals", more_animals);
+  bool refused = false;
+  try {
+    srv.WaitForAllTasks();
+  } catch (MemoryBudgetExceeded&) {
+    refused = true;
+  }
+  ASSERT(refused);
+}
+
+void TestLoadGenerator() {
+  vector<string> docs;
+  for (int i = 0; i < 200; ++i) {
+    docs.push_back("doc" + to_string(i) + " shared word" + to_string(i % 10));
+  }
+  const string docs_text = Join('\n', docs);
+  istringstream docs_input(docs_text);
+  SearchServer srv(docs_input);
+  srv.WaitForAllTasks();
+
+  LoadTestOptions options;
+  options.target_qps = 2000;
+  options.streams = 4;
+  options.duration = 300ms;
+  options.update_documents = docs_text;
+  options.update_period = 100ms;
+  const auto report = RunLoadTest(srv, {"shared", "word3 doc7", "missing"}, options);
+
+  ASSERT_EQUAL(report.all.count, 600u);
+  ASSERT_EQUAL(report.during_updates.count + report.between_updates.count, 600u);
+  ASSERT_EQUAL(report.updates, 2u);
+  ASSERT(report.achieved_qps > 0);
+  ASSERT(report.all.p50 <= report.all.p90);
+  ASSERT(report.all.p90 <= report.all.p99);
+  ASSERT(report.all.p99 <= report.all.p999);
+  ASSERT(report.all.p999 <= report.all.max);
+}
+
+void TestBenchStatistics() {
+  const auto result = SummarizeBench({12, 10, 30, 11, 10}, 100);
+  ASSERT_EQUAL(result.iterations, 100u);
+  ASSERT_EQUAL(result.median_ns, 11.0);
+  ASSERT_EQUAL(result.mad_ns, 1.0);
+  ASSERT_EQUAL(result.OpsPerSecond(), 1e9 / 11);
+
+  BenchOptions options;
+  options.warmup = 1;
+  options.repetitions = 3;
+  options.min_time = 1ms;
+  Benchmark bench(options);
+  size_t calls = 0;
+  bench.Measure([&] {
+    ++calls;
+    ClobberMemory();
+  });
+  ASSERT(bench.Result().iterations > 0);
+  ASSERT(calls >= (options.warmup + options.repetitions) * bench.Result().iterations);
+  ASSERT(bench.Result().median_ns > 0);
+}
+
 void TestSpeed()
 {
     {
@@ -225,12 +1320,163 @@ void TestSpeed()
     DUR_PRINT_ALL;
 }
 
-int main() {
+string MakeBenchDocuments(size_t count) {
+  mt19937 gen(42);
+  uniform_int_distribution<int> word(0, 9999);
+  ostringstream docs;
+  for (size_t i = 0; i < count; ++i) {
+    for (int w = 0; w < 40; ++w) {
+      docs << " w" << word(gen);
+    }
+    docs << '\n';
+  }
+  return docs.str();
+}
+
+void BenchSplitIntoWordsView(Benchmark& bench) {
+  const string line = MakeBenchDocuments(1);
+  bench.Measure([&] {
+    DoNotOptimize(SplitIntoWordsView(line));
+  });
+}
+
+void MeasureIndexBuild(Benchmark& bench, const IndexOptions& options) {
+  const string docs = MakeBenchDocuments(2000);
+  bench.Measure([&] {
+    istringstream docs_input(docs);
+    InvertedIndex index(docs_input, options);
+    DoNotOptimize(index);
+  });
+}
+
+void MeasureLookupAndSum(Benchmark& bench, const IndexOptions& options) {
+  istringstream docs_input(MakeBenchDocuments(20000));
+  InvertedIndex index(docs_input, options);
+  vector<size_t> docHits(index.DocsCount());
+  const vector<string> words = {"w1", "w42", "w777", "w5000", "w9999", "missing"};
+  bench.Measure([&] {
+    fill(docHits.begin(), docHits.end(), 0);
+    for (const auto& word : words) {
+      index.LookupAndSum(word, docHits);
+    }
+    ClobberMemory();
+  });
+}
+
+void BenchRepeatedWordQuery(Benchmark& bench) {
+  istringstream docs_input(MakeBenchDocuments(20000));
+  const InvertedIndex index(docs_input);
+  const auto words = SplitIntoWordsView("w1 w1 w1 w1 w1 w1 w42 w42");
+  vector<size_t> docHits(index.DocsCount());
+  bench.Measure([&] {
+    fill(docHits.begin(), docHits.end(), 0);
+    index.SumPlan(index.PlanQuery(words), docHits);
+    ClobberMemory();
+  });
+}
+
+void BenchIndexBuild(Benchmark& bench) {
+  MeasureIndexBuild(bench, {});
+}
+
+void BenchIndexBuildContiguous(Benchmark& bench) {
+  IndexOptions options;
+  options.postings = PostingsLayout::Contiguous;
+  MeasureIndexBuild(bench, options);
+}
+
+void BenchLookupAndSum(Benchmark& bench) {
+  MeasureLookupAndSum(bench, {});
+}
+
+void BenchLookupAndSumContiguous(Benchmark& bench) {
+  IndexOptions options;
+  options.postings = PostingsLayout::Contiguous;
+  MeasureLookupAndSum(bench, options);
+}
+
+void MeasureSelect(Benchmark& bench, size_t k) {
+  mt19937 gen(7);
+  uniform_int_distribution<size_t> hits(0, 50);
+  vector<size_t> docHits(20000);
+  for (auto& h : docHits) {
+    h = hits(gen);
+  }
+  bench.Measure([&] {
+    SearchResult result(k);
+    result.Select(docHits);
+    DoNotOptimize(result);
+  });
+}
+
+void BenchSearchResultSelect(Benchmark& bench) {
+  MeasureSelect(bench, MAX_OUTPUT);
+}
+
+void BenchSearchResultSelect100(Benchmark& bench) {
+  MeasureSelect(bench, 100);
+}
+
+// With --bench runs the microbenchmarks instead of the tests; --baseline
+// FILE compares them against FILE, or stores them there with --record.
+int main(int argc, char* argv[]) {
   TestRunner tr;
+  bool bench = false;
+  string baseline;
+  bool record = false;
+  double tolerance = 0.15;
+  for (int i = 1; i < argc; ++i) {
+    const string_view arg = argv[i];
+    if (arg == "--bench") {
+      bench = true;
+    } else if (arg == "--baseline" && i + 1 < argc) {
+      baseline = argv[++i];
+    } else if (arg == "--record") {
+      record = true;
+    } else if (arg == "--tolerance" && i + 1 < argc) {
+      tolerance = stod(argv[++i]);
+    }
+  }
+  if (bench) {
+    if (!baseline.empty()) {
+      tr.SetBenchBaseline(baseline, tolerance, record);
+    }
+    RUN_BENCH(tr, BenchSplitIntoWordsView);
+    RUN_BENCH(tr, BenchIndexBuild);
+    RUN_BENCH(tr, BenchIndexBuildContiguous);
+    RUN_BENCH(tr, BenchLookupAndSum);
+    RUN_BENCH(tr, BenchLookupAndSumContiguous);
+    RUN_BENCH(tr, BenchRepeatedWordQuery);
+    RUN_BENCH(tr, BenchSearchResultSelect);
+    RUN_BENCH(tr, BenchSearchResultSelect100);
+    return 0;
+  }
+
+  RUN_TEST(tr, TestBenchStatistics);
   RUN_TEST(tr, TestSerpFormat);
   RUN_TEST(tr, TestTop5);
   RUN_TEST(tr, TestHitcount);
   RUN_TEST(tr, TestRanking);
   RUN_TEST(tr, TestBasicSearch);
+  RUN_TEST(tr, TestDenseTerms);
+  RUN_TEST(tr, TestCompactDictionary);
+  RUN_TEST(tr, TestContiguousPostings);
+  RUN_TEST(tr, TestBlockCompression);
+  RUN_TEST(tr, TestDocumentStore);
+  RUN_TEST(tr, TestPrefixQuery);
+  RUN_TEST(tr, TestTopKSelection);
+  RUN_TEST(tr, TestResultPaging);
+  RUN_TEST(tr, TestPairCache);
+  RUN_TEST(tr, TestQueryPlanner);
+  RUN_TEST(tr, TestExplain);
+  RUN_TEST(tr, TestQueryPipeline);
+  RUN_TEST(tr, TestPriorityScheduler);
+  RUN_TEST(tr, TestCpuQuota);
+  RUN_TEST(tr, TestStreamDeadlines);
+  RUN_TEST(tr, TestMemoryBudget);
+  RUN_TEST(tr, TestMultipleIndexes);
+  RUN_TEST(tr, TestLoadGenerator);
+  RUN_TEST(tr, TestShardedSearch);
+  RUN_TEST(tr, TestQueryFrontend);
   RUN_TEST(tr, TestSpeed);
 }
@@ -0,0 +1,377 @@
+#include <algorithm>
+#include <iterator>
+#include <limits>
+
+#include "pair_cache.h"
+#include "search_server.h"
+
+using namespace std;
+
+namespace
+{
+bool IsPrefixWord(string_view word)
+{
+    return word.size() > 1 && word.back() == '*';
+}
+
+size_t MergedBytes(const DocHits& merged)
+{
+    return merged.capacity() * sizeof(DocHits::value_type);
+}
+}
+
+void TermPairCache::SetBudget(size_t bytes)
+{
+    lock_guard<mutex> lock(m_mutex);
+    m_budget = bytes;
+
+    if (m_budget == 0)
+    {
+        m_pairs.clear();
+        m_stats.merged_pairs = 0;
+        m_stats.bytes = 0;
+    }
+    else
+    {
+        MakeRoom(0, numeric_limits<size_t>::max());
+    }
+}
+
+TermPairCache::Stats TermPairCache::GetStats() const
+{
+    lock_guard<mutex> lock(m_mutex);
+    return m_stats;
+}
+
+vector<shared_ptr<const DocHits>> TermPairCache::Plan(const vector<string_view>& words,
+                                                      const InvertedIndex& index,
+                                                      vector<string_view>& remaining)
+{
+    remaining.assign(words.begin(), words.end());
+    vector<shared_ptr<const DocHits>> result;
+    lock_guard<mutex> lock(m_mutex);
+
+    if (m_budget == 0)
+        return result;
+
+    // Not prepared by the update: the lists come back as queries ask for them
+    if (index.Version() != m_version)
+    {
+        m_version = index.Version();
+        DropMerged();
+    }
+
+    vector<string_view> terms;
+
+    for (string_view word : words)
+    {
+        if (!IsPrefixWord(word))
+            terms.push_back(word);
+    }
+    sort(terms.begin(), terms.end());
+    terms.erase(unique(terms.begin(), terms.end()), terms.end());
+    terms.resize(min(terms.size(), MAX_PAIRED_TERMS));
+
+    if (terms.size() < 2)
+        return result;
+
+    string key;
+    size_t merges = 0;
+    // Elements of an unordered_map keep their address when it rehashes
+    vector<Entry*> queried;
+
+    for (size_t i = 0; i < terms.size(); ++i)
+    {
+        for (size_t j = i + 1; j < terms.size(); ++j)
+        {
+            MakeKey(terms[i], terms[j], key);
+            auto [it, inserted] = m_pairs.try_emplace(hash<string>()(key));
+            Entry& entry = it->second;
+
+            if (inserted)
+                entry.terms = key;
+            else if (entry.terms != key)
+                continue;
+
+            // A pair that did not fit is retried once it got twice as hot
+            if (++entry.queries >= max(MIN_PAIR_QUERIES, 2 * entry.rejected_at)
+                    && !entry.merged && !entry.no_gain && merges < MAX_MERGES_PER_QUERY)
+            {
+                ++merges;
+                Admit(entry, index);
+            }
+
+            queried.push_back(&entry);
+        }
+    }
+
+    // Admitting may have evicted pairs of this same query
+    vector<Entry*> merged;
+    copy_if(queried.begin(), queried.end(), back_inserter(merged),
+            [](Entry* entry) { return entry->merged != nullptr; });
+
+    // A word repeated in the query is summed as often as it occurs, so each
+    // occurrence can be covered by one merged list
+    auto termIndex = [&terms](string_view word)
+    {
+        return lower_bound(terms.begin(), terms.end(), word) - terms.begin();
+    };
+    vector<size_t> occurrences(terms.size());
+
+    for (string_view word : words)
+    {
+        const size_t term = termIndex(word);
+
+        if (term < terms.size() && terms[term] == word)
+            ++occurrences[term];
+    }
+    vector<size_t> covered(terms.size());
+
+    // Longer lists save more scanning
+    sort(merged.begin(), merged.end(), [](Entry* lhs, Entry* rhs)
+    {
+        return lhs->merged->size() > rhs->merged->size();
+    });
+    for (Entry* entry : merged)
+    {
+        auto [first, second] = SplitKey(entry->terms);
+        const size_t a = termIndex(first);
+        const size_t b = termIndex(second);
+        const size_t uses = min(occurrences[a] - covered[a], occurrences[b] - covered[b]);
+        covered[a] += uses;
+        covered[b] += uses;
+        m_stats.hits += uses;
+        result.insert(result.end(), uses, entry->merged);
+    }
+
+    if (!result.empty())
+    {
+        remaining.clear();
+
+        for (string_view word : words)
+        {
+            const size_t term = termIndex(word);
+
+            if (term < terms.size() && terms[term] == word && covered[term] > 0)
+                --covered[term];
+            else
+                remaining.push_back(word);
+        }
+    }
+
+    if (m_pairs.size() > MAX_TRACKED_PAIRS)
+        Forget();
+
+    return result;
+}
+
+void TermPairCache::MakeKey(string_view first, string_view second, string& key)
+{
+    key.assign(first);
+    key.push_back('\0');
+    key.append(second);
+}
+
+pair<string_view, string_view> TermPairCache::SplitKey(string_view key)
+{
+    const size_t separator = key.find('\0');
+    return {key.substr(0, separator), key.substr(separator + 1)};
+}
+
+TermPairCache::Prepared TermPairCache::Prepare(const InvertedIndex& index) const
+{
+    Prepared result;
+    vector<pair<size_t, const Entry*>> hot;
+    size_t budget;
+    {
+        lock_guard<mutex> lock(m_mutex);
+        budget = m_budget;
+
+        if (budget == 0)
+            return result;
+
+        for (const auto& [key, entry] : m_pairs)
+        {
+            if (entry.queries >= MIN_PAIR_QUERIES)
+                hot.emplace_back(entry.queries, &entry);
+        }
+        sort(hot.begin(), hot.end(), [](const auto& lhs, const auto& rhs)
+        {
+            return lhs.first > rhs.first;
+        });
+        for (const auto& [queries, entry] : hot)
+        {
+            result.pairs.push_back({hash<string>()(entry->terms), entry->terms, nullptr, true});
+        }
+    }
+
+    vector<size_t> docHits;
+    size_t bytes = 0;
+
+    // Hottest first, skipping the lists that no longer fit
+    for (auto& candidate : result.pairs)
+    {
+        candidate.merged = Merge(candidate.terms, index, docHits);
+
+        if (!candidate.merged)
+            continue;
+
+        const size_t candidateBytes = MergedBytes(*candidate.merged);
+
+        if (bytes + candidateBytes > budget)
+        {
+            candidate.merged.reset();
+            candidate.fits = false;
+        }
+        else
+        {
+            bytes += candidateBytes;
+        }
+    }
+    return result;
+}
+
+void TermPairCache::Install(size_t version, Prepared&& prepared)
+{
+    lock_guard<mutex> lock(m_mutex);
+    m_version = version;
+    DropMerged();
+
+    for (auto& candidate : prepared.pairs)
+    {
+        auto it = m_pairs.find(candidate.key);
+
+        if (it == m_pairs.end() || it->second.terms != candidate.terms)
+            continue;
+
+        Entry& entry = it->second;
+
+        if (!candidate.fits
+                || (candidate.merged
+                    && m_stats.bytes + MergedBytes(*candidate.merged) > m_budget))
+        {
+            // Retried once twice as hot
+            entry.rejected_at = entry.queries;
+        }
+        else if (!candidate.merged)
+        {
+            entry.no_gain = true;
+        }
+        else
+        {
+            m_stats.bytes += MergedBytes(*candidate.merged);
+            ++m_stats.merged_pairs;
+            entry.merged = move(candidate.merged);
+        }
+    }
+}
+
+void TermPairCache::DropMerged()
+{
+    for (auto& [key, entry] : m_pairs)
+    {
+        entry.merged.reset();
+        entry.rejected_at = 0;
+        entry.no_gain = false;
+    }
+    m_stats.merged_pairs = 0;
+    m_stats.bytes = 0;
+}
+
+shared_ptr<const DocHits> TermPairCache::Merge(string_view terms, const InvertedIndex& index,
+                                               vector<size_t>& docHits)
+{
+    auto [first, second] = SplitKey(terms);
+    docHits.assign(index.DocsCount(), 0);
+    index.LookupAndSum(first, docHits);
+    index.LookupAndSum(second, docHits);
+
+    const size_t docs = docHits.size() - count(docHits.begin(), docHits.end(), 0);
+
+    // Terms that never share a document merge into a list as long as the
+    // two it replaces
+    if (docs >= index.PostingsLength(first) + index.PostingsLength(second))
+        return nullptr;
+
+    auto merged = make_shared<DocHits>();
+    merged->reserve(docs);
+
+    for (size_t docid = 0; docid < docHits.size(); ++docid)
+    {
+        if (docHits[docid] > 0)
+            merged->emplace_back(docid, docHits[docid]);
+    }
+    return merged;
+}
+
+void TermPairCache::Admit(Entry& entry, const InvertedIndex& index)
+{
+    auto merged = Merge(entry.terms, index, m_mergeHits);
+
+    if (!merged)
+    {
+        entry.no_gain = true;
+        return;
+    }
+
+    const size_t bytes = MergedBytes(*merged);
+
+    if (!MakeRoom(bytes, entry.queries))
+    {
+        entry.rejected_at = entry.queries;
+        return;
+    }
+    entry.merged = move(merged);
+    ++m_stats.merged_pairs;
+    m_stats.bytes += bytes;
+}
+
+bool TermPairCache::MakeRoom(size_t bytes, size_t queries)
+{
+    if (bytes > m_budget)
+        return false;
+
+    vector<Entry*> colder;
+    size_t colderBytes = 0;
+
+    for (auto& [hash, entry] : m_pairs)
+    {
+        if (entry.merged && entry.queries < queries)
+        {
+            colder.push_back(&entry);
+            colderBytes += MergedBytes(*entry.merged);
+        }
+    }
+    if (m_stats.bytes + bytes > m_budget + colderBytes)
+        return false;
+
+    sort(colder.begin(), colder.end(), [](Entry* lhs, Entry* rhs)
+    {
+        return lhs->queries < rhs->queries;
+    });
+    for (auto it = colder.begin(); m_stats.bytes + bytes > m_budget; ++it)
+    {
+        m_stats.bytes -= MergedBytes(*(*it)->merged);
+        --m_stats.merged_pairs;
+        (*it)->merged.reset();
+    }
+    return true;
+}
+
+void TermPairCache::Forget()
+{
+    // Down to half the limit, so this runs once per many queries
+    for (size_t round = 0; round < 64 && m_pairs.size() > MAX_TRACKED_PAIRS / 2; ++round)
+    {
+        for (auto it = m_pairs.begin(); it != m_pairs.end(); )
+        {
+            it->second.queries /= 2;
+            it->second.rejected_at /= 2;
+
+            if (it->second.queries == 0 && !it->second.merged)
+                it = m_pairs.erase(it);
+            else
+                ++it;
+        }
+    }
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "top_k.h"
+
+using namespace std;
+
+class InvertedIndex;
+
+// Counts how often pairs of terms are queried together and keeps the
+// merged postings of the hottest pairs, so a query holding both terms
+// scans one list instead of two. The merged lists belong to one index
+// version. An update merges them for its new index before publishing it;
+// otherwise a new version drops them and queries merge them again, each
+// at most MAX_MERGES_PER_QUERY pairs.
+class TermPairCache
+{
+public:
+    // A pair is merged once this many queries contained it
+    static const size_t MIN_PAIR_QUERIES = 4;
+    // Past this many tracked pairs the counts are halved, and the pairs that
+    // drop to zero forgotten, until half as many are left
+    static const size_t MAX_TRACKED_PAIRS = 4096;
+    // Pairs are only formed from the first distinct terms of a query
+    static const size_t MAX_PAIRED_TERMS = 8;
+    // Bounds the merging a query waits for
+    static const size_t MAX_MERGES_PER_QUERY = 1;
+
+    // Merged postings of the hot pairs for an index not yet published
+    struct Prepared
+    {
+        struct Pair
+        {
+            size_t key;
+            string terms;
+            // Null when merging would not shorten the scan or the list
+            // did not fit the budget
+            shared_ptr<const DocHits> merged;
+            bool fits = true;
+        };
+        vector<Pair> pairs;
+    };
+
+    struct Stats
+    {
+        size_t merged_pairs = 0;
+        size_t bytes = 0;
+        // Lists used by queries, each replacing two postings scans
+        size_t hits = 0;
+    };
+
+    // Bytes of merged postings to keep; 0 turns the cache off
+    void SetBudget(size_t bytes);
+
+    // Records the term pairs of words and returns the merged postings that
+    // cover some of them; the words still to be looked up are put in
+    // remaining. Call it while holding the index.
+    vector<shared_ptr<const DocHits>> Plan(const vector<string_view>& words,
+                                           const InvertedIndex& index,
+                                           vector<string_view>& remaining);
+
+    // Merges the hot pairs for index without holding the cache, so
+    // queries of the current index go on meanwhile
+    Prepared Prepare(const InvertedIndex& index) const;
+    // Makes prepared the lists of the index version; call it while holding
+    // the index, as that version is published
+    void Install(size_t version, Prepared&& prepared);
+
+    Stats GetStats() const;
+
+private:
+    struct Entry
+    {
+        // The two terms in order, separated by a zero byte
+        string terms;
+        size_t queries = 0;
+        // queries when the merged list last did not fit
+        size_t rejected_at = 0;
+        // Merging would not shorten the scan for the current index
+        bool no_gain = false;
+        shared_ptr<const DocHits> merged;
+    };
+    // By hash of the terms; a pair whose hash is taken by another is not tracked
+    using Pairs = unordered_map<size_t, Entry>;
+
+    static void MakeKey(string_view first, string_view second, string& key);
+    static pair<string_view, string_view> SplitKey(string_view key);
+    // The merged postings of the pair terms, or null if they would be as
+    // long as the two lists; docHits is scratch space
+    static shared_ptr<const DocHits> Merge(string_view terms, const InvertedIndex& index,
+                                           vector<size_t>& docHits);
+    void DropMerged();
+    void Admit(Entry& entry, const InvertedIndex& index);
+    // Evicts merged lists of pairs queried less than queries, coldest
+    // first, if that makes room for bytes more
+    bool MakeRoom(size_t bytes, size_t queries);
+    void Forget();
+
+    mutable mutex m_mutex;
+    size_t m_budget = 0;
+    size_t m_version = 0;
+    Stats m_stats;
+    Pairs m_pairs;
+    vector<size_t> m_mergeHits;
+};
@@ -0,0 +1,121 @@
+#include "priority_scheduler.h"
+
+using namespace std;
+
+PriorityScheduler::PriorityScheduler(size_t threads)
+{
+    threads = max<size_t>(threads, 1);
+    m_threads.reserve(threads);
+
+    for (size_t i = 0; i < threads; ++i)
+    {
+        m_threads.emplace_back([this] { WorkerLoop(); });
+    }
+}
+
+PriorityScheduler::~PriorityScheduler()
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_hasTasks.notify_all();
+
+    for (auto& t : m_threads)
+    {
+        t.join();
+    }
+}
+
+void PriorityScheduler::Post(function<void()> task, int priority, Clock::time_point deadline)
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_tasks.push({priority, deadline, m_sequence++, move(task)});
+    }
+    m_hasTasks.notify_one();
+}
+
+void PriorityScheduler::WorkerLoop()
+{
+    for (;;)
+    {
+        function<void()> task;
+        {
+            unique_lock<mutex> lock(m_mutex);
+            m_hasTasks.wait(lock, [this] { return m_stopping || !m_tasks.empty(); });
+
+            // Pending tasks are still run on shutdown
+            if (m_tasks.empty())
+                return;
+
+            // top() is const, the entry is popped right away
+            task = move(const_cast<Entry&>(m_tasks.top()).task);
+            m_tasks.pop();
+        }
+        task();
+    }
+}
+
+void CpuQuota::SetLimit(size_t tasks)
+{
+    vector<Waiting> released;
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_limit = tasks;
+        released = TakeReleased();
+    }
+    for (auto& waiting : released)
+    {
+        Submit(move(waiting));
+    }
+}
+
+void CpuQuota::Post(function<void()> task, int priority,
+                    PriorityScheduler::Clock::time_point deadline)
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+
+        if (!HasRoom())
+        {
+            m_waiting.push({priority, deadline, m_sequence++, move(task)});
+            return;
+        }
+        ++m_submitted;
+    }
+    Submit({priority, deadline, 0, move(task)});
+}
+
+vector<CpuQuota::Waiting> CpuQuota::TakeReleased()
+{
+    vector<Waiting> result;
+
+    while (!m_waiting.empty() && HasRoom())
+    {
+        // top() is const, the entry is popped right away
+        result.push_back(move(const_cast<Waiting&>(m_waiting.top())));
+        m_waiting.pop();
+        ++m_submitted;
+    }
+    return result;
+}
+
+void CpuQuota::Submit(Waiting&& waiting)
+{
+    m_scheduler.Post([this, task = move(waiting.task)]
+    {
+        task();
+
+        vector<Waiting> released;
+        {
+            lock_guard<mutex> lock(m_mutex);
+            --m_submitted;
+            released = TakeReleased();
+        }
+        for (auto& next : released)
+        {
+            Submit(move(next));
+        }
+    }, waiting.priority, waiting.deadline);
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include "executor.h"
+
+using namespace std;
+
+// Worker threads running the most urgent posted task first: higher
+// priority first, then earlier deadline, then posting order
+class PriorityScheduler
+{
+public:
+    using Clock = chrono::steady_clock;
+
+    explicit PriorityScheduler(size_t threads = thread::hardware_concurrency());
+    ~PriorityScheduler();
+    PriorityScheduler(const PriorityScheduler&) = delete;
+    PriorityScheduler& operator=(const PriorityScheduler&) = delete;
+
+    void Post(function<void()> task, int priority, Clock::time_point deadline);
+
+    size_t ThreadCount() const
+    {
+        return m_threads.size();
+    }
+
+private:
+    struct Entry
+    {
+        int priority;
+        Clock::time_point deadline;
+        size_t sequence;
+        function<void()> task;
+
+        // priority_queue puts the greatest entry on top
+        bool operator < (const Entry& other) const
+        {
+            if (priority != other.priority)
+                return priority < other.priority;
+            if (deadline != other.deadline)
+                return deadline > other.deadline;
+            return sequence > other.sequence;
+        }
+    };
+
+    void WorkerLoop();
+
+    mutex m_mutex;
+    condition_variable m_hasTasks;
+    priority_queue<Entry> m_tasks;
+    size_t m_sequence = 0;
+    bool m_stopping = false;
+    vector<thread> m_threads;
+};
+
+// Caps how many tasks posted through it a PriorityScheduler holds at once,
+// queued or running. The others wait here in the scheduler's order and are
+// passed on as earlier ones finish, so a busy tenant cannot fill every
+// worker while the others' tasks queue behind it.
+class CpuQuota
+{
+public:
+    explicit CpuQuota(PriorityScheduler& scheduler) :
+        m_scheduler(scheduler)
+    {}
+
+    // 0, the default, means no cap
+    void SetLimit(size_t tasks);
+
+    void Post(function<void()> task, int priority, PriorityScheduler::Clock::time_point deadline);
+
+private:
+    struct Waiting
+    {
+        int priority;
+        PriorityScheduler::Clock::time_point deadline;
+        size_t sequence;
+        function<void()> task;
+
+        bool operator < (const Waiting& other) const
+        {
+            if (priority != other.priority)
+                return priority < other.priority;
+            if (deadline != other.deadline)
+                return deadline > other.deadline;
+            return sequence > other.sequence;
+        }
+    };
+
+    bool HasRoom() const
+    {
+        return m_limit == 0 || m_submitted < m_limit;
+    }
+
+    // Takes the waiting tasks that fit under the limit; call it locked
+    vector<Waiting> TakeReleased();
+    void Submit(Waiting&& waiting);
+
+    PriorityScheduler& m_scheduler;
+    mutex m_mutex;
+    size_t m_limit = 0;
+    size_t m_submitted = 0;
+    size_t m_sequence = 0;
+    priority_queue<Waiting> m_waiting;
+};
+
+// Posts to a PriorityScheduler on behalf of one query stream. Every task
+// gets the stream priority and a deadline of the stream's budget from now,
+// so streams of equal priority are served earliest deadline first. With a
+// quota the tasks count against it.
+class StreamExecutor : public Executor
+{
+public:
+    StreamExecutor(PriorityScheduler& scheduler, int priority,
+                   PriorityScheduler::Clock::duration budget,
+                   CpuQuota* quota = nullptr) :
+        m_scheduler(scheduler),
+        m_priority(priority),
+        m_budget(budget),
+        m_quota(quota)
+    {}
+
+    void Post(function<void()> task) override
+    {
+        const auto deadline = m_budget.count() > 0
+                ? PriorityScheduler::Clock::now() + m_budget
+                : PriorityScheduler::Clock::time_point::max();
+
+        if (m_quota)
+            m_quota->Post(move(task), m_priority, deadline);
+        else
+            m_scheduler.Post(move(task), m_priority, deadline);
+    }
+
+private:
+    PriorityScheduler& m_scheduler;
+    int m_priority;
+    PriorityScheduler::Clock::duration m_budget;
+    CpuQuota* m_quota;
+};
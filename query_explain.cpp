@@ -0,0 +1,51 @@
+#include <algorithm>
+
+#include "query_explain.h"
+
+using namespace std;
+
+ostream& operator << (ostream& os, const QueryExplanation& explanation)
+{
+    using chrono::duration_cast;
+    using chrono::microseconds;
+
+    os << explanation.query << ':'
+       << " index_version: " << explanation.index_version
+       << ", tokenize_us: " << duration_cast<microseconds>(explanation.tokenize).count()
+       << ", lookup_us: " << duration_cast<microseconds>(explanation.lookup).count()
+       << ", select_us: " << duration_cast<microseconds>(explanation.select).count()
+       << ", docs_touched: " << explanation.docs_touched
+       << ", postings: {";
+
+    bool first = true;
+
+    for (auto [word, length] : explanation.postings)
+    {
+        os << (first ? "" : ", ") << word << ": " << length;
+        first = false;
+    }
+    return os << '}';
+}
+
+void ExplainSink::SetOutput(ostream* output, size_t sample_period)
+{
+    m_samplePeriod = max<size_t>(sample_period, 1);
+    m_output = output;
+}
+
+bool ExplainSink::Sample()
+{
+    if (m_output.load(memory_order_relaxed) == nullptr)
+        return false;
+
+    return m_queries.fetch_add(1, memory_order_relaxed) % m_samplePeriod == 0;
+}
+
+void ExplainSink::Write(const QueryExplanation& explanation)
+{
+    lock_guard<mutex> lock(m_mutex);
+    ostream* output = m_output;
+
+    if (output != nullptr)
+        *output << explanation << '\n';
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Per-stage costs of one query
+struct QueryExplanation
+{
+    string_view query;
+    size_t index_version = 0;
+    chrono::steady_clock::duration tokenize{};
+    chrono::steady_clock::duration lookup{};
+    chrono::steady_clock::duration select{};
+    // Query word and its posting list length in documents
+    vector<pair<string_view, size_t>> postings;
+    size_t docs_touched = 0;
+};
+
+ostream& operator << (ostream& os, const QueryExplanation& explanation);
+
+// Side channel receiving the explanation of every sample_period-th query.
+// Disabled sinks cost one atomic load per query.
+class ExplainSink
+{
+public:
+    void SetOutput(ostream* output, size_t sample_period = 1);
+    bool Sample();
+    void Write(const QueryExplanation& explanation);
+
+private:
+    atomic<ostream*> m_output = nullptr;
+    atomic<size_t> m_samplePeriod = 1;
+    atomic<size_t> m_queries = 0;
+    mutex m_mutex;
+};
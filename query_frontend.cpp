@@ -0,0 +1,451 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "query_frontend.h"
+
+using namespace std;
+
+namespace
+{
+// Pipelined queries a connection may have in flight before it stops being read
+const size_t MAX_PENDING_REPLIES = 64;
+// Longest accepted query line; longer lines drop the connection
+const size_t MAX_QUERY_LENGTH = 64 * 1024;
+const size_t READ_CHUNK = 16 * 1024;
+
+[[noreturn]] void ThrowSystemError(const char* what)
+{
+    throw system_error(errno, generic_category(), what);
+}
+
+void CloseOnError(int fd, const char* what)
+{
+    int error = errno;
+    close(fd);
+    errno = error;
+    ThrowSystemError(what);
+}
+}
+
+QueryFrontend::QueryFrontend(SearchServer& server, string index_name) :
+    m_server(server),
+    m_indexName(move(index_name))
+{
+    const auto names = m_server.GetIndexNames();
+
+    if (find(names.begin(), names.end(), m_indexName) == names.end())
+        throw out_of_range("no index " + m_indexName);
+
+    m_epoll = epoll_create1(EPOLL_CLOEXEC);
+
+    if (m_epoll < 0)
+        ThrowSystemError("epoll_create1");
+
+    m_wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (m_wakeup < 0)
+        CloseOnError(m_epoll, "eventfd");
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = m_wakeup;
+
+    if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_wakeup, &event) < 0)
+    {
+        close(m_wakeup);
+        CloseOnError(m_epoll, "epoll_ctl");
+    }
+}
+
+QueryFrontend::~QueryFrontend()
+{
+    {
+        unique_lock<mutex> lock(m_completionsMutex);
+        m_drained.wait(lock, [this] { return m_inFlight == 0; });
+    }
+
+    for (auto& [fd, connection] : m_connections)
+    {
+        connection->closed = true;
+        close(fd);
+    }
+    for (int fd : m_listeners)
+    {
+        close(fd);
+    }
+    for (const auto& path : m_unixPaths)
+    {
+        unlink(path.c_str());
+    }
+    close(m_wakeup);
+    close(m_epoll);
+}
+
+uint16_t QueryFrontend::ListenTcp(const string& address, uint16_t port)
+{
+    sockaddr_in socket_address{};
+    socket_address.sin_family = AF_INET;
+    socket_address.sin_port = htons(port);
+
+    if (inet_pton(AF_INET, address.c_str(), &socket_address.sin_addr) != 1)
+        throw invalid_argument("bad IPv4 address: " + address);
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+    if (fd < 0)
+        ThrowSystemError("socket");
+
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    socklen_t length = sizeof(socket_address);
+
+    if (bind(fd, reinterpret_cast<const sockaddr*>(&socket_address), sizeof(socket_address)) < 0
+            || listen(fd, SOMAXCONN) < 0
+            || getsockname(fd, reinterpret_cast<sockaddr*>(&socket_address), &length) < 0)
+    {
+        CloseOnError(fd, "tcp listen");
+    }
+    AddListener(fd);
+    return ntohs(socket_address.sin_port);
+}
+
+void QueryFrontend::ListenUnix(const string& socket_path)
+{
+    sockaddr_un socket_address{};
+    socket_address.sun_family = AF_UNIX;
+
+    if (socket_path.size() >= sizeof(socket_address.sun_path))
+        throw invalid_argument("socket path is too long: " + socket_path);
+
+    strncpy(socket_address.sun_path, socket_path.c_str(), sizeof(socket_address.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+    if (fd < 0)
+        ThrowSystemError("socket");
+
+    unlink(socket_path.c_str());
+
+    if (bind(fd, reinterpret_cast<const sockaddr*>(&socket_address), sizeof(socket_address)) < 0
+            || listen(fd, SOMAXCONN) < 0)
+    {
+        CloseOnError(fd, "unix listen");
+    }
+    m_unixPaths.push_back(socket_path);
+    AddListener(fd);
+}
+
+void QueryFrontend::AddListener(int fd)
+{
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+
+    if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &event) < 0)
+        CloseOnError(fd, "epoll_ctl");
+
+    m_listeners.push_back(fd);
+}
+
+void QueryFrontend::Run()
+{
+    static const int MAX_EVENTS = 256;
+    epoll_event events[MAX_EVENTS];
+
+    while (!m_stopping)
+    {
+        int count = epoll_wait(m_epoll, events, MAX_EVENTS, -1);
+
+        if (count < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            ThrowSystemError("epoll_wait");
+        }
+
+        for (int i = 0; i < count; ++i)
+        {
+            const int fd = events[i].data.fd;
+
+            if (fd == m_wakeup)
+            {
+                uint64_t counter;
+                while (read(m_wakeup, &counter, sizeof(counter)) > 0)
+                {}
+                ApplyCompletions();
+                continue;
+            }
+            if (find(m_listeners.begin(), m_listeners.end(), fd) != m_listeners.end())
+            {
+                Accept(fd);
+                continue;
+            }
+
+            auto found = m_connections.find(fd);
+
+            if (found == m_connections.end())
+                continue;
+
+            // Keep the connection alive while its handlers may close it
+            auto connection = found->second;
+
+            // The peer can no longer receive answers
+            if (events[i].events & (EPOLLHUP | EPOLLERR))
+                Close(connection);
+            else if (events[i].events & EPOLLIN)
+                ReadFrom(connection);
+            if (!connection->closed && (events[i].events & EPOLLOUT))
+                WriteTo(connection);
+        }
+    }
+}
+
+void QueryFrontend::Stop()
+{
+    m_stopping = true;
+    Wake();
+}
+
+void QueryFrontend::Wake()
+{
+    const uint64_t one = 1;
+    [[maybe_unused]] auto written = write(m_wakeup, &one, sizeof(one));
+}
+
+void QueryFrontend::Accept(int listener)
+{
+    for (;;)
+    {
+        int fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            // EAGAIN when the backlog is drained; EMFILE and the like are
+            // retried on the next readiness notification
+            return;
+        }
+
+        auto connection = make_shared<Connection>();
+        connection->fd = fd;
+        connection->events = EPOLLIN;
+
+        epoll_event event{};
+        event.events = connection->events;
+        event.data.fd = fd;
+
+        if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &event) < 0)
+        {
+            close(fd);
+            continue;
+        }
+        m_connections[fd] = move(connection);
+    }
+}
+
+void QueryFrontend::ReadFrom(const shared_ptr<Connection>& connection)
+{
+    char buffer[READ_CHUNK];
+
+    while (!connection->readClosed
+           && connection->replies.size() < MAX_PENDING_REPLIES)
+    {
+        ssize_t got = read(connection->fd, buffer, sizeof(buffer));
+
+        if (got < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                Close(connection);
+                return;
+            }
+            break;
+        }
+        if (got == 0)
+        {
+            connection->readClosed = true;
+            break;
+        }
+
+        connection->input.append(buffer, got);
+        DispatchLines(connection);
+
+        // Complete lines are all dispatched unless replies are at the limit,
+        // so what is left is the start of one query
+        if (connection->replies.size() < MAX_PENDING_REPLIES
+                && connection->input.size() > MAX_QUERY_LENGTH)
+        {
+            Close(connection);
+            return;
+        }
+    }
+
+    FlushReplies(connection);
+}
+
+void QueryFrontend::DispatchLines(const shared_ptr<Connection>& connection)
+{
+    string& input = connection->input;
+    size_t lineStart = 0;
+
+    // Lines past the limit wait in input until replies drain
+    while (connection->replies.size() < MAX_PENDING_REPLIES)
+    {
+        const size_t eol = input.find('\n', lineStart);
+
+        if (eol == string::npos)
+            break;
+
+        size_t lineEnd = eol;
+
+        if (lineEnd > lineStart && input[lineEnd - 1] == '\r')
+            --lineEnd;
+
+        if (lineEnd > lineStart)
+            Dispatch(connection, input.substr(lineStart, lineEnd - lineStart));
+        lineStart = eol + 1;
+    }
+    input.erase(0, lineStart);
+
+    // A final query may come without the trailing newline
+    if (connection->readClosed && !input.empty() && input.find('\n') == string::npos
+            && connection->replies.size() < MAX_PENDING_REPLIES)
+    {
+        Dispatch(connection, move(input));
+        input.clear();
+    }
+}
+
+void QueryFrontend::Dispatch(const shared_ptr<Connection>& connection, string query)
+{
+    connection->replies.emplace_back();
+    Reply* reply = &connection->replies.back();
+
+    {
+        lock_guard<mutex> lock(m_completionsMutex);
+        ++m_inFlight;
+    }
+    m_server.AnswerQueryAsync(m_indexName, move(query), [this, connection, reply](string text)
+    {
+        lock_guard<mutex> lock(m_completionsMutex);
+        m_completions.push_back({connection, reply, move(text)});
+        Wake();
+        --m_inFlight;
+        m_drained.notify_all();
+    });
+}
+
+void QueryFrontend::ApplyCompletions()
+{
+    {
+        lock_guard<mutex> lock(m_completionsMutex);
+        swap(m_applying, m_completions);
+    }
+
+    for (auto& completion : m_applying)
+    {
+        if (completion.connection->closed)
+            continue;
+
+        completion.reply->text = move(completion.text);
+        completion.reply->ready = true;
+    }
+    for (auto& completion : m_applying)
+    {
+        if (!completion.connection->closed)
+            FlushReplies(completion.connection);
+    }
+    m_applying.clear();
+}
+
+void QueryFrontend::FlushReplies(const shared_ptr<Connection>& connection)
+{
+    if (connection->closed)
+        return;
+
+    auto& replies = connection->replies;
+
+    while (!replies.empty() && replies.front().ready)
+    {
+        connection->output += replies.front().text;
+        replies.pop_front();
+    }
+    DispatchLines(connection);
+    WriteTo(connection);
+}
+
+void QueryFrontend::WriteTo(const shared_ptr<Connection>& connection)
+{
+    string& output = connection->output;
+    size_t sent = 0;
+
+    while (sent < output.size())
+    {
+        ssize_t written = send(connection->fd, output.data() + sent,
+                               output.size() - sent, MSG_NOSIGNAL);
+
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                Close(connection);
+                return;
+            }
+            break;
+        }
+        sent += written;
+    }
+    output.erase(0, sent);
+
+    if (connection->readClosed && connection->replies.empty() && output.empty()
+            && connection->input.empty())
+    {
+        Close(connection);
+        return;
+    }
+    UpdateEvents(connection);
+}
+
+void QueryFrontend::UpdateEvents(const shared_ptr<Connection>& connection)
+{
+    uint32_t events = 0;
+
+    if (!connection->readClosed && connection->replies.size() < MAX_PENDING_REPLIES)
+        events |= EPOLLIN;
+    if (!connection->output.empty())
+        events |= EPOLLOUT;
+
+    if (events == connection->events)
+        return;
+
+    epoll_event event{};
+    event.events = events;
+    event.data.fd = connection->fd;
+    epoll_ctl(m_epoll, EPOLL_CTL_MOD, connection->fd, &event);
+    connection->events = events;
+}
+
+void QueryFrontend::Close(const shared_ptr<Connection>& connection)
+{
+    if (connection->closed)
+        return;
+
+    connection->closed = true;
+    epoll_ctl(m_epoll, EPOLL_CTL_DEL, connection->fd, nullptr);
+    close(connection->fd);
+    m_connections.erase(connection->fd);
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "search_server.h"
+
+using namespace std;
+
+// Event-driven network front end of a SearchServer. Clients send
+// newline-delimited queries and may pipeline them; each connection gets
+// its answers in the AddQueriesStream line format, in query order.
+// One thread runs the epoll loop; the queries go to one index of the
+// server and run on its CPU workers, within that index's CPU quota.
+class QueryFrontend
+{
+public:
+    explicit QueryFrontend(SearchServer& server, string index_name = {});
+    ~QueryFrontend();
+    QueryFrontend(const QueryFrontend&) = delete;
+    QueryFrontend& operator=(const QueryFrontend&) = delete;
+
+    // Returns the bound port, which is useful when port is 0
+    uint16_t ListenTcp(const string& address, uint16_t port);
+    void ListenUnix(const string& socket_path);
+
+    // Serves connections until Stop() is called from any thread
+    void Run();
+    void Stop();
+
+private:
+    struct Reply
+    {
+        string text;
+        bool ready = false;
+    };
+
+    struct Connection
+    {
+        int fd;
+        string input;
+        string output;
+        deque<Reply> replies;
+        bool readClosed = false;
+        bool closed = false;
+        uint32_t events = 0;
+    };
+
+    struct Completion
+    {
+        shared_ptr<Connection> connection;
+        Reply* reply;
+        string text;
+    };
+
+    void AddListener(int fd);
+    void Accept(int listener);
+    void ReadFrom(const shared_ptr<Connection>& connection);
+    void WriteTo(const shared_ptr<Connection>& connection);
+    void FlushReplies(const shared_ptr<Connection>& connection);
+    void UpdateEvents(const shared_ptr<Connection>& connection);
+    void Close(const shared_ptr<Connection>& connection);
+    void DispatchLines(const shared_ptr<Connection>& connection);
+    void Dispatch(const shared_ptr<Connection>& connection, string query);
+    void ApplyCompletions();
+    void Wake();
+
+    SearchServer& m_server;
+    int m_epoll = -1;
+    int m_wakeup = -1;
+    vector<int> m_listeners;
+    vector<string> m_unixPaths;
+    unordered_map<int, shared_ptr<Connection>> m_connections;
+    atomic<bool> m_stopping = false;
+
+    mutex m_completionsMutex;
+    vector<Completion> m_completions;
+    vector<Completion> m_applying;
+    // Queries posted to the server and not completed yet; the destructor
+    // waits for them, as they wake the loop through the eventfd
+    size_t m_inFlight = 0;
+    condition_variable m_drained;
+
+    const string m_indexName;
+};
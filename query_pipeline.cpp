@@ -0,0 +1,337 @@
+#include <algorithm>
+#include <memory>
+
+#include "query_pipeline.h"
+#include "coro.h"
+#include "parse.h"
+
+using namespace std;
+
+const char* QueryStageName(QueryStage stage)
+{
+    switch (stage)
+    {
+    case QueryStage::Read:   return "read";
+    case QueryStage::Parse:  return "parse";
+    case QueryStage::Lookup: return "lookup";
+    case QueryStage::Rank:   return "rank";
+    case QueryStage::Format: return "format";
+    }
+    return "unknown";
+}
+
+void ParseQuery(QueryState& query, ExplainSink& explain)
+{
+    if (!explain.Sample())
+    {
+        query.words = SplitIntoWordsView(query.text);
+        return;
+    }
+
+    query.explanation.emplace();
+    query.explanation->query = query.text;
+    const auto start = chrono::steady_clock::now();
+    query.words = SplitIntoWordsView(query.text);
+    query.explanation->tokenize = chrono::steady_clock::now() - start;
+}
+
+void LookupQuery(QueryState& query, Synchronized<InvertedIndex>& index,
+                 TermPairCache& pair_cache)
+{
+    auto access = index.GetAccess();
+    const auto start = chrono::steady_clock::now();
+    query.index_status = access.ref_to_value.Status();
+    query.docHits.assign(access.ref_to_value.DocsCount(), 0);
+
+    vector<string_view> remaining;
+
+    for (const auto& merged : pair_cache.Plan(query.words, access.ref_to_value, remaining))
+    {
+        for (auto [docid, hits] : *merged)
+        {
+            query.docHits[docid] += hits;
+        }
+    }
+    const auto plan = access.ref_to_value.PlanQuery(move(remaining));
+    access.ref_to_value.SumPlan(plan, query.docHits);
+
+    if (auto& explanation = query.explanation)
+    {
+        explanation->lookup = chrono::steady_clock::now() - start;
+        explanation->index_version = access.ref_to_value.Version();
+
+        for (const auto& word : query.words)
+        {
+            explanation->postings.emplace_back(word, access.ref_to_value.PostingsLength(word));
+        }
+    }
+}
+
+void RankQuery(QueryState& query)
+{
+    const auto start = chrono::steady_clock::now();
+    query.result.Select(query.docHits);
+
+    if (auto& explanation = query.explanation)
+    {
+        explanation->select = chrono::steady_clock::now() - start;
+        explanation->docs_touched = query.docHits.size()
+                - count(query.docHits.begin(), query.docHits.end(), 0);
+    }
+}
+
+void FormatQuery(QueryState& query, ostream& search_results_output, ExplainSink& explain,
+                 string_view note)
+{
+    if (query.index_status != IndexStatus::Ready)
+    {
+        const char* status = query.index_status == IndexStatus::Rebuilding
+                ? "index rebuilding" : "index build failed";
+        const string notes = note.empty() ? string(status) : string(note) + ", " + status;
+        PrintSearchResult(search_results_output, query.text, query.result, notes);
+    }
+    else
+    {
+        PrintSearchResult(search_results_output, query.text, query.result, note);
+    }
+
+    if (query.explanation)
+        explain.Write(*query.explanation);
+}
+
+namespace
+{
+const size_t CHANNEL_CAPACITY = 16;
+
+using QueryChannel = Channel<unique_ptr<QueryState>>;
+
+class QueryPipeline
+{
+public:
+    QueryPipeline(istream& query_input,
+                  ostream& search_results_output,
+                  IndexTenant& tenant,
+                  ExplainSink& explain,
+                  HitsBufferPool& hits_buffers,
+                  const StreamOptions& options,
+                  PriorityScheduler& cpu_scheduler,
+                  ThreadPool& io_executor) :
+        input(query_input),
+        output(search_results_output),
+        index(tenant.index),
+        pairCache(tenant.pair_cache),
+        explain(explain),
+        stats(tenant.stats),
+        hitsBuffers(hits_buffers),
+        options(options),
+        cpu(cpu_scheduler, options.priority, options.deadline, &tenant.cpu_quota),
+        io(io_executor),
+        lines(CHANNEL_CAPACITY),
+        parsed(CHANNEL_CAPACITY),
+        found(CHANNEL_CAPACITY),
+        ranked(CHANNEL_CAPACITY)
+    {}
+
+    future<void> GetFuture()
+    {
+        return m_done.get_future();
+    }
+
+    // Stops every stage; the first error is reported by the future
+    void Fail(exception_ptr error)
+    {
+        {
+            lock_guard<mutex> lock(m_mutex);
+
+            if (!m_error)
+                m_error = error;
+        }
+        for (auto channel : {&lines, &parsed, &found, &ranked})
+        {
+            channel->Close(true);
+        }
+    }
+
+    void StageDone()
+    {
+        lock_guard<mutex> lock(m_mutex);
+
+        if (--m_runningStages > 0)
+            return;
+
+        if (m_error)
+            m_done.set_exception(m_error);
+        else
+            m_done.set_value();
+    }
+
+    istream& input;
+    ostream& output;
+    Synchronized<InvertedIndex>& index;
+    TermPairCache& pairCache;
+    ExplainSink& explain;
+    PipelineStats& stats;
+    HitsBufferPool& hitsBuffers;
+    const StreamOptions options;
+    StreamExecutor cpu;
+    ThreadPool& io;
+
+    QueryChannel lines;
+    QueryChannel parsed;
+    QueryChannel found;
+    QueryChannel ranked;
+
+private:
+    mutex m_mutex;
+    exception_ptr m_error;
+    size_t m_runningStages = QUERY_STAGE_COUNT;
+    promise<void> m_done;
+};
+
+Task read_stage(shared_ptr<QueryPipeline> pipeline)
+{
+    try
+    {
+        for (;;)
+        {
+            auto query = make_unique<QueryState>();
+            query->result = SearchResult(pipeline->options.page.value_or(ResultPage{}));
+            const auto start = chrono::steady_clock::now();
+            bool got = false;
+
+            while (!got && getline(pipeline->input, query->text))
+            {
+                got = !query->text.empty();
+            }
+            if (!got)
+                break;
+
+            const auto finish = chrono::steady_clock::now();
+            pipeline->stats.Add(QueryStage::Read, finish - start);
+
+            if (pipeline->options.deadline.count() > 0)
+                query->deadline = finish + pipeline->options.deadline;
+
+            if (!co_await pipeline->lines.Send(move(query), pipeline->io))
+                break;
+        }
+    }
+    catch (...)
+    {
+        pipeline->Fail(current_exception());
+    }
+    pipeline->lines.Close();
+    pipeline->StageDone();
+}
+
+template <typename Work>
+Task transform_stage(shared_ptr<QueryPipeline> pipeline,
+                     QueryChannel& in,
+                     QueryChannel& out,
+                     QueryStage stage,
+                     Work work)
+{
+    try
+    {
+        while (auto query = co_await in.Receive(pipeline->cpu))
+        {
+            const auto start = chrono::steady_clock::now();
+            work(**query);
+            pipeline->stats.Add(stage, chrono::steady_clock::now() - start);
+
+            if (!co_await out.Send(move(*query), pipeline->cpu))
+                break;
+
+            // Other streams may have become more urgent
+            co_await Yield{pipeline->cpu};
+        }
+    }
+    catch (...)
+    {
+        pipeline->Fail(current_exception());
+    }
+    out.Close();
+    pipeline->StageDone();
+}
+
+Task format_stage(shared_ptr<QueryPipeline> pipeline)
+{
+    try
+    {
+        while (auto query = co_await pipeline->ranked.Receive(pipeline->io))
+        {
+            const auto start = chrono::steady_clock::now();
+            QueryState& state = **query;
+            const bool missed = state.dropped || start > state.deadline;
+
+            if (!missed)
+            {
+                FormatQuery(state, pipeline->output, pipeline->explain);
+            }
+            else
+            {
+                pipeline->stats.AddDeadlineMiss();
+
+                if (pipeline->options.on_deadline_miss == DeadlineMissPolicy::Mark)
+                    FormatQuery(state, pipeline->output, pipeline->explain, "deadline missed");
+            }
+            pipeline->stats.Add(QueryStage::Format, chrono::steady_clock::now() - start);
+        }
+    }
+    catch (...)
+    {
+        pipeline->Fail(current_exception());
+    }
+    pipeline->StageDone();
+}
+}
+
+future<void> StartQueryPipeline(istream& query_input,
+                                ostream& search_results_output,
+                                IndexTenant& tenant,
+                                ExplainSink& explain,
+                                HitsBufferPool& hits_buffers,
+                                const StreamOptions& options,
+                                PriorityScheduler& cpu_scheduler,
+                                ThreadPool& io_executor)
+{
+    auto pipeline = make_shared<QueryPipeline>(query_input, search_results_output,
+                                               tenant, explain, hits_buffers, options,
+                                               cpu_scheduler, io_executor);
+    auto result = pipeline->GetFuture();
+    QueryPipeline& p = *pipeline;
+
+    auto parse = transform_stage(pipeline, p.lines, p.parsed, QueryStage::Parse,
+                                 [&explain = p.explain](QueryState& query)
+    {
+        ParseQuery(query, explain);
+    });
+    auto lookup = transform_stage(pipeline, p.parsed, p.found, QueryStage::Lookup,
+                                  [&p](QueryState& query)
+    {
+        if (p.options.on_deadline_miss == DeadlineMissPolicy::Drop
+                && chrono::steady_clock::now() > query.deadline)
+        {
+            query.dropped = true;
+            return;
+        }
+        query.docHits = p.hitsBuffers.Take();
+        LookupQuery(query, p.index, p.pairCache);
+    });
+    auto rank = transform_stage(pipeline, p.found, p.ranked, QueryStage::Rank,
+                                [&p](QueryState& query)
+    {
+        if (query.dropped)
+            return;
+
+        RankQuery(query);
+        p.hitsBuffers.Return(move(query.docHits));
+    });
+
+    read_stage(pipeline).Start(io_executor);
+    parse.Start(p.cpu);
+    lookup.Start(p.cpu);
+    rank.Start(p.cpu);
+    format_stage(pipeline).Start(io_executor);
+    return result;
+}
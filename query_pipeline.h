@@ -0,0 +1,58 @@
+#pragma once
+
+#include <future>
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "search_server.h"
+#include "stage_stats.h"
+#include "thread_pool.h"
+#include "priority_scheduler.h"
+
+using namespace std;
+
+// A query on its way through the stages; words point into text
+struct QueryState
+{
+    QueryState() :
+        result(MAX_OUTPUT)
+    {}
+
+    string text;
+    vector<string_view> words;
+    vector<size_t> docHits;
+    SearchResult result;
+    // Set for the queries ExplainSink sampled
+    optional<QueryExplanation> explanation;
+    chrono::steady_clock::time_point deadline = chrono::steady_clock::time_point::max();
+    // Missed its deadline in a DeadlineMissPolicy::Drop stream
+    bool dropped = false;
+    // Of the index the query was looked up in
+    IndexStatus index_status = IndexStatus::Ready;
+};
+
+void ParseQuery(QueryState& query, ExplainSink& explain);
+void LookupQuery(QueryState& query, Synchronized<InvertedIndex>& index,
+                 TermPairCache& pair_cache);
+void RankQuery(QueryState& query);
+// Writes the result line; an index that is not ready is mentioned in the note
+void FormatQuery(QueryState& query, ostream& search_results_output, ExplainSink& explain,
+                 string_view note = {});
+
+// Runs read -> parse -> lookup -> rank -> format as coroutines connected by
+// bounded channels. Reading and formatting, which may block on the streams,
+// run on io_executor; the other stages on cpu_scheduler with the stream
+// priority and deadline, within the tenant's CPU quota, and give way to more
+// urgent streams between queries.
+future<void> StartQueryPipeline(istream& query_input,
+                                ostream& search_results_output,
+                                IndexTenant& tenant,
+                                ExplainSink& explain,
+                                HitsBufferPool& hits_buffers,
+                                const StreamOptions& options,
+                                PriorityScheduler& cpu_scheduler,
+                                ThreadPool& io_executor);
@@ -2,27 +2,119 @@
 #include <sstream>
 #include <iostream>
 #include <cassert>
+#include <limits>
+#include <cmath>
 
 #include "search_server.h"
 #include "iterator_range.h"
 #include "profile.h"
 #include "parse.h"
+#include "query_pipeline.h"
 
 using namespace std;
 
-InvertedIndex::InvertedIndex(istream& document_input)
+namespace
 {
+// Red-black tree node header: three links and the color
+const size_t TREE_NODE_BYTES = 4 * sizeof(void*);
+// Build cost assumed before any index has been measured: a tree node and a
+// doubled-capacity posting for every word
+const size_t DEFAULT_BUILD_BYTES_PER_WORD =
+        TREE_NODE_BYTES + sizeof(pair<string_view, DocHits>) + 2 * sizeof(DocHits::value_type);
+
+size_t StringHeapBytes(const string& s)
+{
+    const char* object = reinterpret_cast<const char*>(&s);
+    const bool local = s.data() >= object && s.data() < object + sizeof(s);
+    return local ? 0 : s.capacity() + 1;
+}
+
+size_t CountWords(string_view text)
+{
+    size_t result = 0;
+    bool inWord = false;
+
+    for (char c : text)
+    {
+        const bool space = isspace(static_cast<unsigned char>(c));
+        result += !space && !inWord;
+        inWord = !space;
+    }
+    return result;
+}
+}
+
+InvertedIndex::InvertedIndex(istream& document_input,
+                             const IndexOptions& options) :
+    InvertedIndex(ReadDocuments(document_input), options)
+{
+}
+
+deque<string> InvertedIndex::ReadDocuments(istream& document_input)
+{
+    deque<string> result;
+
     for (string current_document; getline(document_input, current_document); )
     {
-        if (current_document.empty())
-            continue;
+        if (!current_document.empty())
+            result.push_back(move(current_document));
+    }
+    return result;
+}
 
-        m_docs.push_back(move(current_document));
-        const size_t docid = m_docs.size() - 1;
+InvertedIndex::InvertedIndex(deque<string> documents,
+                             const IndexOptions& options) :
+    m_options(options),
+    m_docsCount(documents.size()),
+    m_docs(move(documents))
+{
+    if (m_options.before_build)
+        m_options.before_build();
+
+    if (m_options.postings == PostingsLayout::Contiguous)
+        BuildContiguous();
+    else
+        BuildPerTerm();
+
+    StoreDocuments();
+    m_memoryUsage = MeasureMemoryUsage();
+}
+
+void InvertedIndex::StoreDocuments()
+{
+    if (m_options.documents == DocumentStore::Keep)
+        return;
+
+    if (m_options.documents == DocumentStore::Compressed)
+        m_compressedDocs = CompressedDocuments(m_docs);
+
+    deque<string>().swap(m_docs);
+}
 
-        for (string_view word : SplitIntoWordsView(m_docs.back()))
+string InvertedIndex::GetDocument(size_t id) const
+{
+    switch (m_options.documents)
+    {
+    case DocumentStore::Keep:
+        return m_docs.at(id);
+    case DocumentStore::Compressed:
+        return m_compressedDocs.Get(id);
+    case DocumentStore::Discard:
+        break;
+    }
+    throw logic_error("document text was discarded after indexing");
+}
+
+void InvertedIndex::BuildPerTerm()
+{
+    map<string_view, DocHits> index;
+
+    for (size_t docid = 0; docid < m_docs.size(); ++docid)
+    {
+        for (string_view word : SplitIntoWordsView(m_docs[docid]))
         {
-            DocHits& docHits = m_index[word];
+            DocHits& docHits = index[word];
+            ++m_words;
 
             if (!docHits.empty() && docHits.back().first == docid)
             {
@@ -34,102 +126,674 @@ InvertedIndex::InvertedIndex(istream& document_input)
             }
         }
     }
+
+    // The build peaks here: the tree and its postings are all alive
+    m_buildBytes = index.size() * (TREE_NODE_BYTES + sizeof(pair<string_view, DocHits>)
+                                   + sizeof(TermPostings));
+    for (const auto& [word, docHits] : index)
+    {
+        m_buildBytes += docHits.capacity() * sizeof(DocHits::value_type);
+    }
+
+    BuildDictionary(index);
+    m_postings.reserve(index.size());
+
+    for (auto& [word, docHits] : index)
+    {
+        m_postings.push_back({move(docHits), {}});
+    }
+    CompactDenseTerms();
 }
 
-template <typename DocHitsMap>
-void InvertedIndex::LookupAndSum(string_view word,
-                                 DocHitsMap& docid_count) const
+struct InvertedIndex::TermCount
+{
+    // Number of documents containing the term, then where its next posting goes
+    size_t postings = 0;
+    size_t lastDocid = numeric_limits<size_t>::max();
+};
+
+void InvertedIndex::BuildContiguous()
 {
-    auto it = m_index.find(word);
+    map<string_view, TermCount> counts;
+    // The term of every word in document order, so the second pass does not
+    // tokenize and search the tree again
+    vector<TermCount*> wordTerms;
+    vector<size_t> docWordsEnd;
+    docWordsEnd.reserve(m_docs.size());
 
-    if (it != m_index.end())
+    for (size_t docid = 0; docid < m_docs.size(); ++docid)
     {
-        for (auto& [docid, hits] : it->second)
+        for (string_view word : SplitIntoWordsView(m_docs[docid]))
         {
-            docid_count[docid] += hits;
+            TermCount& count = counts[word];
+            wordTerms.push_back(&count);
+
+            if (count.lastDocid != docid)
+            {
+                ++count.postings;
+                count.lastDocid = docid;
+            }
         }
+        docWordsEnd.push_back(wordTerms.size());
     }
-}
+    m_words = wordTerms.size();
 
-SearchServer::SearchServer(istream& document_input)
-{
-    UpdateDocumentBase(document_input);
+    m_hitOffsets.reserve(counts.size() + 1);
+    m_hitOffsets.push_back(0);
+
+    for (auto& [word, count] : counts)
+    {
+        const size_t offset = m_hitOffsets.back();
+        m_hitOffsets.push_back(offset + count.postings);
+        count.postings = offset;
+        count.lastDocid = numeric_limits<size_t>::max();
+    }
+    m_hits.resize(m_hitOffsets.back());
+
+    // Documents are visited in docid order, so a word already seen in the
+    // current document has its posting last among those of its term
+    size_t word = 0;
+
+    for (size_t docid = 0; docid < m_docs.size(); ++docid)
+    {
+        for ( ; word < docWordsEnd[docid]; ++word)
+        {
+            TermCount& count = *wordTerms[word];
+
+            if (count.lastDocid == docid)
+            {
+                ++m_hits[count.postings - 1].second;
+            }
+            else
+            {
+                m_hits[count.postings++] = make_pair(docid, 1);
+                count.lastDocid = docid;
+            }
+        }
+    }
+
+    m_buildBytes = counts.size() * (TREE_NODE_BYTES + sizeof(pair<string_view, TermCount>))
+                 + wordTerms.capacity() * sizeof(TermCount*)
+                 + docWordsEnd.capacity() * sizeof(size_t)
+                 + m_hits.size() * sizeof(DocHits::value_type)
+                 + m_hitOffsets.size() * sizeof(size_t);
+    BuildDictionary(counts);
 }
 
-void update_document_base(istream& document_input, Synchronized<InvertedIndex>& index)
+template <typename TermMap>
+void InvertedIndex::BuildDictionary(const TermMap& terms)
 {
-    bool flag = true;
+    if (m_options.dictionary == TermDictionaryType::Compact)
     {
-        auto access = index.GetAccess();
-        if (access.ref_to_value.DocsCount() == 0)
+        vector<string_view> words;
+        words.reserve(terms.size());
+
+        for (const auto& item : terms)
         {
-            access.ref_to_value = move(InvertedIndex(document_input));
-            flag = false;
+            words.push_back(item.first);
         }
+        m_compactTerms = CompactTermDictionary(words);
+        return;
     }
-    if (flag)
+
+    if (m_options.documents == DocumentStore::Keep)
     {
-        InvertedIndex new_index(document_input);
-        index.GetAccess().ref_to_value = move(new_index);
+        for (const auto& item : terms)
+        {
+            m_termTree.emplace_hint(m_termTree.end(), item.first, m_termTree.size());
+        }
+        return;
+    }
+
+    // The documents the terms point into go away: copy the terms into an
+    // arena sized up front, so the views into it stay valid
+    size_t arenaSize = 0;
+
+    for (const auto& item : terms)
+    {
+        arenaSize += item.first.size();
+    }
+    m_termArena.reserve(arenaSize);
+
+    for (const auto& item : terms)
+    {
+        const string_view term(m_termArena.data() + m_termArena.size(), item.first.size());
+        m_termArena.insert(m_termArena.end(), item.first.begin(), item.first.end());
+        m_termTree.emplace_hint(m_termTree.end(), term, m_termTree.size());
     }
 }
 
-void SearchServer::UpdateDocumentBase(istream& document_input)
+IndexMemoryUsage InvertedIndex::MeasureMemoryUsage() const
 {
-    m_tasks.push_back(async(update_document_base, ref(document_input), ref(m_index)));
+    IndexMemoryUsage usage;
+    usage.documents = m_docs.size() * sizeof(string) + m_compressedDocs.MemoryBytes();
+
+    for (const auto& document : m_docs)
+    {
+        const size_t heap = StringHeapBytes(document);
+        usage.documents += heap;
+
+        if (heap > 0)
+            usage.slack += document.capacity() - document.size();
+    }
+
+    if (m_options.dictionary == TermDictionaryType::Compact)
+        usage.dictionary = m_compactTerms.MemoryBytes();
+    else
+        usage.dictionary = m_termTree.size()
+                * (TREE_NODE_BYTES + sizeof(decltype(m_termTree)::value_type))
+                + m_termArena.capacity();
+
+    usage.postings = m_postings.capacity() * sizeof(TermPostings)
+                   + m_hits.capacity() * sizeof(DocHits::value_type)
+                   + m_hitOffsets.capacity() * sizeof(size_t);
+    usage.slack += (m_postings.capacity() - m_postings.size()) * sizeof(TermPostings)
+                 + (m_hits.capacity() - m_hits.size()) * sizeof(DocHits::value_type)
+                 + (m_hitOffsets.capacity() - m_hitOffsets.size()) * sizeof(size_t);
+
+    for (const auto& postings : m_postings)
+    {
+        usage.postings += postings.hits.capacity() * sizeof(DocHits::value_type)
+                        + postings.single_hits.MemoryBytes();
+        usage.slack += (postings.hits.capacity() - postings.hits.size())
+                     * sizeof(DocHits::value_type);
+    }
+    return usage;
 }
 
-void process_query_stream(istream& query_input,
-                          ostream& search_results_output,
-                          Synchronized<InvertedIndex>& index)
+CorpusSize InvertedIndex::MeasureCorpus(const deque<string>& documents)
 {
-    static const size_t MAX_OUTPUT = 5;
+    CorpusSize result;
+    result.document_bytes = documents.size() * sizeof(string);
 
-    for (string current_query; getline(query_input, current_query); )
+    for (const auto& document : documents)
     {
-        if (current_query.empty())
-            continue;
+        result.document_bytes += StringHeapBytes(document);
+        result.words += CountWords(document);
+    }
+    return result;
+}
+
+size_t InvertedIndex::EstimateBuildMemory(const CorpusSize& corpus) const
+{
+    const double bytesPerWord = m_words > 0
+            ? double(m_buildBytes) / m_words
+            : DEFAULT_BUILD_BYTES_PER_WORD;
+    return corpus.document_bytes + static_cast<size_t>(corpus.words * bytesPerWord);
+}
+
+optional<size_t> InvertedIndex::FindTerm(string_view word) const
+{
+    if (m_options.dictionary == TermDictionaryType::Compact)
+        return m_compactTerms.Find(word);
+
+    auto it = m_termTree.find(word);
+
+    if (it == m_termTree.end())
+        return nullopt;
+    return it->second;
+}
+
+size_t InvertedIndex::PostingsLength(string_view word) const
+{
+    auto [first, last] = ResolveWord(word);
+    size_t result = 0;
+
+    for (size_t term = first; term < last; ++term)
+    {
+        result += TermDocsCount(term);
+    }
+    return result;
+}
+
+pair<size_t, size_t> InvertedIndex::ResolveWord(string_view word) const
+{
+    if (word.size() > 1 && word.back() == '*')
+        return FindPrefix(word.substr(0, word.size() - 1));
+
+    if (auto term = FindTerm(word))
+        return {*term, *term + 1};
+
+    return {0, 0};
+}
 
-        const auto words = SplitIntoWordsView(current_query);
-        vector<size_t> docHits(0);
+vector<QueryTerm> InvertedIndex::PlanQuery(vector<string_view> words) const
+{
+    sort(words.begin(), words.end());
+    vector<QueryTerm> plan;
+
+    for (size_t i = 0; i < words.size(); )
+    {
+        QueryTerm queryTerm;
+        queryTerm.word = words[i];
 
+        for ( ; i < words.size() && words[i] == queryTerm.word; ++i)
         {
-            auto access = index.GetAccess();
-            docHits.resize(access.ref_to_value.DocsCount(), 0);
+            ++queryTerm.multiplicity;
+        }
+        tie(queryTerm.first, queryTerm.last) = ResolveWord(queryTerm.word);
 
-            for (const auto& word : words)
-            {
-                access.ref_to_value.LookupAndSum(word, docHits);
-            }
+        for (size_t term = queryTerm.first; term < queryTerm.last; ++term)
+        {
+            queryTerm.postings += TermDocsCount(term);
         }
+        if (queryTerm.postings > 0)
+            plan.push_back(queryTerm);
+    }
+
+    stable_sort(plan.begin(), plan.end(), [](const QueryTerm& lhs, const QueryTerm& rhs)
+    {
+        return lhs.postings < rhs.postings;
+    });
+    return plan;
+}
+
+size_t InvertedIndex::TermsCount() const
+{
+    if (m_options.postings == PostingsLayout::Contiguous)
+        return m_hitOffsets.empty() ? 0 : m_hitOffsets.size() - 1;
+    return m_postings.size();
+}
+
+size_t InvertedIndex::TermDocsCount(size_t term) const
+{
+    if (m_options.postings == PostingsLayout::Contiguous)
+        return m_hitOffsets[term + 1] - m_hitOffsets[term];
+    return m_postings[term].DocsCount();
+}
+
+pair<size_t, size_t> InvertedIndex::FindPrefix(string_view prefix) const
+{
+    if (m_options.dictionary == TermDictionaryType::Compact)
+        return m_compactTerms.PrefixRange(prefix, MAX_PREFIX_EXPANSION);
 
-        SearchResult search_result(MAX_OUTPUT);
+    auto it = m_termTree.lower_bound(prefix);
 
-        for (size_t doc = 0; doc < docHits.size(); ++doc)
+    if (it == m_termTree.end())
+        return {TermsCount(), TermsCount()};
+
+    const size_t first = it->second;
+    size_t last = first;
+
+    for ( ; it != m_termTree.end() && last - first < MAX_PREFIX_EXPANSION
+            && it->first.substr(0, prefix.size()) == prefix; ++it)
+    {
+        ++last;
+    }
+    return {first, last};
+}
+
+void InvertedIndex::CompactDenseTerms()
+{
+    // A bitmap pays off once it is this many times smaller than the entries it replaces
+    static const size_t MIN_BITMAP_GAIN = 8;
+    const size_t bitmapBytes = DocBitmap::MemoryBytes(m_docsCount);
+
+    for (auto& postings : m_postings)
+    {
+        const size_t singles = count_if(postings.hits.begin(), postings.hits.end(),
+                                        [](const auto& docHits) { return docHits.second == 1; });
+
+        if (singles * sizeof(DocHits::value_type) < MIN_BITMAP_GAIN * bitmapBytes)
+            continue;
+
+        DocBitmap single_hits(m_docsCount);
+        DocHits exceptions;
+        exceptions.reserve(postings.hits.size() - singles);
+
+        for (const auto& docHits : postings.hits)
         {
-            if (docHits[doc] > 0)
-                search_result.PushBack(make_pair(doc, docHits[doc]));
+            if (docHits.second == 1)
+                single_hits.Set(docHits.first);
+            else
+                exceptions.push_back(docHits);
         }
+        postings.hits = move(exceptions);
+        postings.single_hits = move(single_hits);
+    }
+}
 
-        search_results_output << current_query << ':';
+SearchServer::SearchServer(istream& document_input) :
+    SearchServer()
+{
+    UpdateDocumentBase(document_input);
+}
+
+void update_document_base(istream& document_input,
+                          IndexOptions options,
+                          size_t memory_budget,
+                          IndexTenant& tenant)
+{
+    deque<string> documents = InvertedIndex::ReadDocuments(document_input);
+    // Measured before taking the index, queries go on meanwhile
+    const CorpusSize corpus = memory_budget > 0 ? InvertedIndex::MeasureCorpus(documents)
+                                                : CorpusSize();
+    bool dropped = false;
+
+    if (memory_budget > 0)
+    {
+        auto access = tenant.index.GetAccess();
+        InvertedIndex& current = access.ref_to_value;
+        const size_t estimate = current.EstimateBuildMemory(corpus);
 
-        for (auto [docid, hitcount] : search_result)
+        if (estimate > memory_budget)
         {
-            search_results_output
-                << " {" << "docid: " << docid << ", "
-                << "hitcount: " << hitcount << '}';
+            throw MemoryBudgetExceeded("document base update needs about "
+                                       + to_string(estimate) + " bytes, budget is "
+                                       + to_string(memory_budget));
         }
-        search_results_output << endl;
+        // Not enough room for both indexes: free the current one first.
+        // Queries get the empty one, which says it is being rebuilt; its own
+        // version keeps what was cached for the old one from being applied.
+        if (current.MemoryUsage().Total() + estimate > memory_budget)
+        {
+            const size_t version = current.Version() + 1;
+            current = InvertedIndex();
+            current.SetVersion(version);
+            current.SetStatus(IndexStatus::Rebuilding);
+            tenant.memory_bytes = 0;
+            dropped = true;
+        }
+    }
+
+    // Built without holding the index, so the workers its queries share
+    // with other indexes are not blocked meanwhile
+    optional<InvertedIndex> new_index;
+
+    try
+    {
+        new_index.emplace(move(documents), options);
+    }
+    catch (...)
+    {
+        if (dropped)
+            tenant.index.GetAccess().ref_to_value.SetStatus(IndexStatus::Failed);
+        throw;
+    }
+
+    // Merged while queries still use the current index
+    auto merged = tenant.pair_cache.Prepare(*new_index);
+    {
+        auto access = tenant.index.GetAccess();
+        new_index->SetVersion(access.ref_to_value.Version() + 1);
+        tenant.pair_cache.Install(new_index->Version(), move(merged));
+        swap(access.ref_to_value, *new_index);
+        tenant.memory_bytes = access.ref_to_value.MemoryUsage().Total();
+    }
+    // new_index now holds the replaced index, freed without holding the lock
+}
+
+SearchServer::SearchServer()
+{
+    CreateIndex(string(DEFAULT_INDEX));
+}
+
+void SearchServer::CreateIndex(const string& name, const IndexOptions& options)
+{
+    auto tenant = make_unique<IndexTenant>(m_cpuScheduler, options);
+    tenant->pair_cache.SetBudget(m_pairCacheBudget);
+
+    lock_guard<mutex> lock(m_tenantsMutex);
+
+    if (!m_tenants.emplace(name, move(tenant)).second)
+        throw invalid_argument("index " + name + " already exists");
+}
+
+vector<string> SearchServer::GetIndexNames() const
+{
+    lock_guard<mutex> lock(m_tenantsMutex);
+    vector<string> result;
+
+    for (const auto& [name, tenant] : m_tenants)
+    {
+        result.push_back(name);
+    }
+    return result;
+}
+
+IndexTenant& SearchServer::GetTenant(string_view name) const
+{
+    lock_guard<mutex> lock(m_tenantsMutex);
+    auto it = m_tenants.find(name);
+
+    if (it == m_tenants.end())
+        throw out_of_range("no index " + string(name));
+
+    // Indexes are never removed, so the reference stays valid
+    return *it->second;
+}
+
+vector<IndexTenant*> SearchServer::GetTenants() const
+{
+    lock_guard<mutex> lock(m_tenantsMutex);
+    vector<IndexTenant*> result;
+
+    for (const auto& [name, tenant] : m_tenants)
+    {
+        result.push_back(tenant.get());
+    }
+    return result;
+}
+
+void SearchServer::SetCpuQuota(string_view name, double share)
+{
+    if (!(share > 0))
+        throw invalid_argument("CPU quota share must be positive");
+
+    const size_t workers = m_cpuScheduler.ThreadCount();
+    const size_t limit = share >= 1 ? 0 : max<size_t>(1, llround(share * workers));
+    GetTenant(name).cpu_quota.SetLimit(limit);
+}
+
+void SearchServer::SetIndexOptions(const IndexOptions& options)
+{
+    SetIndexOptions(DEFAULT_INDEX, options);
+}
+
+void SearchServer::SetIndexOptions(string_view name, const IndexOptions& options)
+{
+    GetTenant(name).options = options;
+}
+
+void SearchServer::SetResultPage(const ResultPage& page)
+{
+    m_resultPage = page;
+}
+
+void SearchServer::SetMemoryBudget(size_t bytes)
+{
+    m_memoryBudget = bytes;
+}
+
+size_t SearchServer::MemoryBudgetFor(const IndexTenant& tenant, size_t memory_budget) const
+{
+    if (memory_budget == 0)
+        return 0;
+
+    size_t others = 0;
+
+    for (IndexTenant* other : GetTenants())
+    {
+        if (other != &tenant)
+            others += other->memory_bytes.load();
+    }
+    // Not 0, which would mean unlimited
+    return others < memory_budget ? memory_budget - others : 1;
+}
+
+IndexMemoryUsage SearchServer::GetIndexMemoryUsage()
+{
+    return GetIndexMemoryUsage(DEFAULT_INDEX);
+}
+
+IndexMemoryUsage SearchServer::GetIndexMemoryUsage(string_view name)
+{
+    return GetTenant(name).index.GetAccess().ref_to_value.MemoryUsage();
+}
+
+void SearchServer::SetPairCacheBudget(size_t bytes)
+{
+    m_pairCacheBudget = bytes;
+
+    for (IndexTenant* tenant : GetTenants())
+    {
+        tenant->pair_cache.SetBudget(bytes);
+    }
+}
+
+TermPairCache::Stats SearchServer::GetPairCacheStats() const
+{
+    TermPairCache::Stats result;
+
+    for (IndexTenant* tenant : GetTenants())
+    {
+        const auto stats = tenant->pair_cache.GetStats();
+        result.merged_pairs += stats.merged_pairs;
+        result.bytes += stats.bytes;
+        result.hits += stats.hits;
     }
+    return result;
+}
+
+void SearchServer::UpdateDocumentBase(istream& document_input)
+{
+    UpdateDocumentBase(DEFAULT_INDEX, document_input);
+}
+
+void SearchServer::UpdateDocumentBase(string_view name, istream& document_input)
+{
+    IndexTenant& tenant = GetTenant(name);
+    // Built on the shared I/O pool rather than a thread of its own
+    auto update = make_shared<packaged_task<void()>>(
+        [this, &tenant, &document_input, options = tenant.options, budget = m_memoryBudget]
+    {
+        update_document_base(document_input, options, MemoryBudgetFor(tenant, budget), tenant);
+    });
+    m_tasks.push_back(update->get_future());
+    m_ioExecutor.Post([update] { (*update)(); });
 }
 
 void SearchServer::AddQueriesStream(istream& query_input,
-                                    ostream& search_results_output)
+                                    ostream& search_results_output,
+                                    const StreamOptions& options)
+{
+    AddQueriesStream(DEFAULT_INDEX, query_input, search_results_output, options);
+}
+
+void SearchServer::AddQueriesStream(string_view name,
+                                    istream& query_input,
+                                    ostream& search_results_output,
+                                    const StreamOptions& options)
+{
+    IndexTenant& tenant = GetTenant(name);
+    StreamOptions stream = options;
+
+    if (!stream.page)
+        stream.page = m_resultPage;
+
+    m_tasks.push_back(StartQueryPipeline(query_input,
+                                         search_results_output,
+                                         tenant,
+                                         m_explain,
+                                         m_hitsBuffers,
+                                         stream,
+                                         m_cpuScheduler,
+                                         m_ioExecutor));
+}
+
+void SearchServer::AnswerQuery(string_view query,
+                               ostream& search_results_output)
+{
+    AnswerQuery(DEFAULT_INDEX, query, search_results_output, m_resultPage);
+}
+
+void SearchServer::AnswerQuery(string_view query,
+                               ostream& search_results_output,
+                               const ResultPage& page)
+{
+    AnswerQuery(DEFAULT_INDEX, query, search_results_output, page);
+}
+
+void SearchServer::AnswerQuery(string_view name,
+                               string_view query,
+                               ostream& search_results_output,
+                               const ResultPage& page)
+{
+    IndexTenant& tenant = GetTenant(name);
+    QueryState state;
+    state.text = query;
+    state.result = SearchResult(page);
+    ParseQuery(state, m_explain);
+    LookupQuery(state, tenant.index, tenant.pair_cache);
+    RankQuery(state);
+    FormatQuery(state, search_results_output, m_explain);
+}
+
+void SearchServer::AnswerQueryAsync(string_view name,
+                                    string query,
+                                    function<void(string)> done,
+                                    int priority)
+{
+    IndexTenant& tenant = GetTenant(name);
+    auto task = [this, &tenant, query = move(query), done = move(done),
+                 page = m_resultPage]
+    {
+        QueryState state;
+        state.text = query;
+        state.result = SearchResult(page);
+        ParseQuery(state, m_explain);
+        state.docHits = m_hitsBuffers.Take();
+        LookupQuery(state, tenant.index, tenant.pair_cache);
+        RankQuery(state);
+        m_hitsBuffers.Return(move(state.docHits));
+        ostringstream output;
+        FormatQuery(state, output, m_explain);
+        done(output.str());
+    };
+    tenant.cpu_quota.Post(move(task), priority, PriorityScheduler::Clock::time_point::max());
+}
+
+void SearchServer::SetExplainOutput(ostream* explain_output, size_t sample_period)
 {
-    m_tasks.push_back(async(process_query_stream,
-                            ref(query_input),
-                            ref(search_results_output),
-                            ref(m_index)));
+    m_explain.SetOutput(explain_output, sample_period);
+}
+
+StageStats SearchServer::GetStageStats(QueryStage stage) const
+{
+    StageStats result;
+
+    for (IndexTenant* tenant : GetTenants())
+    {
+        const StageStats stats = tenant->stats.Get(stage);
+        result.queries += stats.queries;
+        result.busy += stats.busy;
+    }
+    return result;
+}
+
+StageStats SearchServer::GetStageStats(string_view name, QueryStage stage) const
+{
+    return GetTenant(name).stats.Get(stage);
+}
+
+size_t SearchServer::GetDeadlineMisses() const
+{
+    size_t result = 0;
+
+    for (IndexTenant* tenant : GetTenants())
+    {
+        result += tenant->stats.DeadlineMisses();
+    }
+    return result;
+}
+
+SearchServer::~SearchServer()
+{
+    for (auto& t : m_tasks)
+    {
+        if (t.valid())
+            t.wait();
+    }
 }
 
 void SearchServer::WaitForAllTasks()
@@ -141,6 +805,40 @@ void SearchServer::WaitForAllTasks()
     }
 }
 
+void SearchResult::Select(const vector<size_t>& docHits, size_t docidOffset)
+{
+    if (m_data.empty())
+    {
+        SelectTop(docHits, m_maxSize, docidOffset, m_data);
+        return;
+    }
+
+    for (size_t doc = 0; doc < docHits.size(); ++doc)
+    {
+        if (docHits[doc] > 0)
+            PushBack(make_pair(doc + docidOffset, docHits[doc]));
+    }
+}
+
+void PrintSearchResult(ostream& search_results_output,
+                       string_view query,
+                       const SearchResult& search_result,
+                       string_view note)
+{
+    search_results_output << query << ':';
+
+    for (auto [docid, hitcount] : search_result)
+    {
+        search_results_output
+            << " {" << "docid: " << docid << ", "
+            << "hitcount: " << hitcount << '}';
+    }
+    if (!note.empty())
+        search_results_output << " [" << note << ']';
+
+    search_results_output << endl;
+}
+
 void SearchResult::PushBack(pair<size_t, size_t>&& docHits)
 {
     DocHits::iterator curr = m_data.end();
@@ -150,7 +848,7 @@ void SearchResult::PushBack(pair<size_t, size_t>&& docHits)
         if (prev(curr)->second >= docHits.second)
             break;
     }
-    if (m_data.size() < m_data.capacity())
+    if (m_data.size() < m_maxSize)
     {
         if (curr == m_data.end())
             m_data.push_back(move(docHits));
@@ -1,76 +1,485 @@
 #pragma once
 
+#include <cstdint>
 #include <istream>
 #include <ostream>
 #include <vector>
 #include <deque>
+#include <atomic>
 #include <map>
+#include <memory>
 #include <string>
 #include <mutex>
+#include <functional>
 #include <future>
+#include <optional>
+#include <stdexcept>
 
 #include "synchronized.h"
+#include "doc_bitmap.h"
+#include "doc_store.h"
+#include "hits_pool.h"
+#include "top_k.h"
+#include "pair_cache.h"
+#include "term_dictionary.h"
+#include "query_explain.h"
+#include "stage_stats.h"
+#include "thread_pool.h"
+#include "priority_scheduler.h"
 
 using namespace std;
 
-using DocHits = vector<pair<size_t, size_t>>;
+const size_t MAX_OUTPUT = 5;
+
+// Results ranked offset + 1 to offset + limit
+struct ResultPage
+{
+    size_t offset = 0;
+    size_t limit = MAX_OUTPUT;
+};
+
+// Postings of one term. Terms occurring in a large share of documents keep
+// docids with a single hit in a bitmap and only the rest in the hit list.
+struct TermPostings
+{
+    DocHits hits;
+    DocBitmap single_hits;
+
+    size_t DocsCount() const
+    {
+        return hits.size() + single_hits.Count();
+    }
+};
+
+enum class TermDictionaryType
+{
+    Tree,       // map from term to ordinal, terms point into the documents
+    Compact     // front-coded CompactTermDictionary
+};
+
+enum class PostingsLayout
+{
+    PerTerm,    // a TermPostings per term, dense terms use bitmaps
+    Contiguous  // all postings in one array in term order, built in two passes
+};
+
+// What the index keeps of the document text once it is built
+enum class DocumentStore
+{
+    Keep,       // the documents as read
+    Compressed, // CompressedDocuments, decompressed on GetDocument
+    Discard     // only their number; GetDocument throws
+};
+
+struct IndexOptions
+{
+    TermDictionaryType dictionary = TermDictionaryType::Tree;
+    PostingsLayout postings = PostingsLayout::PerTerm;
+    DocumentStore documents = DocumentStore::Keep;
+    // Called as a build starts; lets tests hold or fail a build
+    function<void()> before_build;
+};
+
+// Whether an index answers from its documents. A rebuilding or failed
+// index is empty: its update dropped the previous index to fit the memory
+// budget, and is building the next one or failed to.
+enum class IndexStatus
+{
+    Ready,
+    Rebuilding,
+    Failed
+};
+
+// Heap bytes held by an index. Slack is allocated but unused capacity and
+// is also counted in the part it belongs to.
+struct IndexMemoryUsage
+{
+    size_t documents = 0;
+    size_t dictionary = 0;
+    size_t postings = 0;
+    size_t slack = 0;
+
+    size_t Total() const
+    {
+        return documents + dictionary + postings;
+    }
+};
+
+// What EstimateBuildMemory needs to know about a corpus
+struct CorpusSize
+{
+    size_t document_bytes = 0;
+    size_t words = 0;
+};
+
+class MemoryBudgetExceeded : public runtime_error
+{
+public:
+    using runtime_error::runtime_error;
+};
+
+// A distinct query word resolved against an index: the terms it covers,
+// their ordinals first to last, and how often the query repeats it
+struct QueryTerm
+{
+    string_view word;
+    size_t multiplicity = 0;
+    size_t first = 0;
+    size_t last = 0;
+    // Documents visited summing the term once
+    size_t postings = 0;
+};
 
 class InvertedIndex
 {
 public:
+    // A query word ending with '*' sums the postings of at most this many
+    // terms starting with the rest of the word, taken in term order
+    static const size_t MAX_PREFIX_EXPANSION = 128;
+
     InvertedIndex() = default;
-    explicit InvertedIndex(istream& document_input);
+    explicit InvertedIndex(istream& document_input,
+                           const IndexOptions& options = {});
+    InvertedIndex(deque<string> documents,
+                  const IndexOptions& options = {});
+
+    // Non-empty lines of the input; their positions are the docids
+    static deque<string> ReadDocuments(istream& document_input);
+
     template <typename DocHitsMap>
     void LookupAndSum(string_view word,
                       DocHitsMap& docid_count) const;
+    // Number of documents LookupAndSum(word) visits
+    size_t PostingsLength(string_view word) const;
 
-    const string& GetDocument(size_t id) const
+    // Collapses repeated words, resolves each once, drops the ones that
+    // match nothing and orders the rest by posting length, shortest first.
+    // Summing the plan gives the same hits as LookupAndSum on every word.
+    vector<QueryTerm> PlanQuery(vector<string_view> words) const;
+    template <typename DocHitsMap>
+    void SumPlan(const vector<QueryTerm>& plan,
+                 DocHitsMap& docid_count) const;
+
+    // Incremented by SearchServer on every document base update
+    size_t Version() const
     {
-        return m_docs[id];
+        return m_version;
     }
 
+    void SetVersion(size_t version)
+    {
+        m_version = version;
+    }
+
+    string GetDocument(size_t id) const;
+
     size_t DocsCount() const
     {
-        return m_docs.size();
+        return m_docsCount;
+    }
+
+    // Measured once built, the index does not change afterwards
+    IndexMemoryUsage MemoryUsage() const
+    {
+        return m_memoryUsage;
+    }
+
+    // A pass over the documents; needs no index
+    static CorpusSize MeasureCorpus(const deque<string>& documents);
+    // Peak bytes needed to index a corpus, extrapolated from what building
+    // this index took per word, or a pessimistic guess for an empty index
+    size_t EstimateBuildMemory(const CorpusSize& corpus) const;
+
+    IndexStatus Status() const
+    {
+        return m_status;
+    }
+
+    void SetStatus(IndexStatus status)
+    {
+        m_status = status;
     }
 
 private:
+    struct TermCount;
+
+    void BuildPerTerm();
+    void BuildContiguous();
+    template <typename TermMap>
+    void BuildDictionary(const TermMap& terms);
+    void CompactDenseTerms();
+    void StoreDocuments();
+    IndexMemoryUsage MeasureMemoryUsage() const;
+
+    size_t TermsCount() const;
+    size_t TermDocsCount(size_t term) const;
+    optional<size_t> FindTerm(string_view word) const;
+    pair<size_t, size_t> FindPrefix(string_view prefix) const;
+    // Term ordinals matching word, a prefix query or a single term
+    pair<size_t, size_t> ResolveWord(string_view word) const;
+    template <typename DocHitsMap>
+    void SumTerm(size_t term, DocHitsMap& docid_count, size_t weight = 1) const;
+    template <typename DocHitsMap>
+    static void SumPostings(const TermPostings& postings,
+                            DocHitsMap& docid_count,
+                            size_t weight);
+
+    IndexOptions m_options;
+    size_t m_version = 0;
+    IndexStatus m_status = IndexStatus::Ready;
+    size_t m_words = 0;
+    size_t m_buildBytes = 0;
+    IndexMemoryUsage m_memoryUsage;
+    size_t m_docsCount = 0;
+    // Filled while building; afterwards only with DocumentStore::Keep
     deque<string> m_docs;
-    map<string_view, DocHits> m_index;
+    CompressedDocuments m_compressedDocs;
+    // Owns the terms of m_termTree when the documents are not kept. Not a
+    // string: a short one keeps its bytes inside the object, and the views
+    // would not follow it when the index is moved.
+    vector<char> m_termArena;
+    // Indexed by term ordinal, i.e. in term order
+    vector<TermPostings> m_postings;
+    // PostingsLayout::Contiguous: the postings of term t are
+    // m_hits[m_hitOffsets[t]] up to m_hits[m_hitOffsets[t + 1]]
+    DocHits m_hits;
+    vector<size_t> m_hitOffsets;
+    map<string_view, size_t> m_termTree;
+    CompactTermDictionary m_compactTerms;
 };
 
+// Keeps the best offset + limit documents and iterates over the last limit
 class SearchResult
 {
 public:
-    SearchResult(size_t maxSize)
+    SearchResult(size_t maxSize) :
+        SearchResult(ResultPage{0, maxSize})
+    {}
+    explicit SearchResult(const ResultPage& page) :
+        m_offset(page.offset),
+        // Saturated, so a limit of SIZE_MAX means all results
+        m_maxSize(page.limit > SIZE_MAX - page.offset ? SIZE_MAX : page.offset + page.limit)
     {
-        m_data.reserve(maxSize);
+        if (m_maxSize <= MAX_FIXED_TOP_K)
+            m_data.reserve(m_maxSize);
     }
     DocHits::const_iterator begin() const
     {
-        return m_data.begin();
+        return m_data.begin() + min(m_offset, m_data.size());
     }
     DocHits::const_iterator end() const
     {
         return m_data.end();
     }
+    size_t size() const
+    {
+        return m_data.size() - min(m_offset, m_data.size());
+    }
     void PushBack(pair<size_t, size_t>&& docHits);
+    void Select(const vector<size_t>& docHits, size_t docidOffset = 0);
 
 private:
+    size_t m_offset;
+    size_t m_maxSize;
     DocHits m_data;
 };
 
+void PrintSearchResult(ostream& search_results_output,
+                       string_view query,
+                       const SearchResult& search_result,
+                       string_view note = {});
+
+enum class DeadlineMissPolicy
+{
+    Mark,   // answer anyway, with " [deadline missed]" after the results
+    Drop    // write no line for the query and skip its remaining work
+};
+
+struct StreamOptions
+{
+    // Queries of higher priority streams are worked on first; streams of
+    // equal priority are served earliest deadline first
+    int priority = 0;
+    // Time from reading a query to writing its answer; zero means no deadline
+    chrono::steady_clock::duration deadline{};
+    DeadlineMissPolicy on_deadline_miss = DeadlineMissPolicy::Mark;
+    // The server's result page when not set
+    optional<ResultPage> page;
+};
+
+// One named document base of a SearchServer and what its queries use
+struct IndexTenant
+{
+    explicit IndexTenant(PriorityScheduler& cpu_scheduler,
+                         const IndexOptions& index_options = {}) :
+        options(index_options),
+        cpu_quota(cpu_scheduler)
+    {}
+
+    IndexOptions options;
+    Synchronized<InvertedIndex> index;
+    // MemoryUsage().Total() of index, set as each version is published, so
+    // other indexes' updates need not wait for index
+    atomic<size_t> memory_bytes{0};
+    TermPairCache pair_cache;
+    PipelineStats stats;
+    CpuQuota cpu_quota;
+};
+
+// Serves any number of named indexes. They share the worker threads, which
+// grow with the streams and updates in progress, the memory budget, the
+// docHits buffers and the explain output; each keeps its own statistics.
+// The calls without an index name use the default index, which always exists.
 class SearchServer
 {
 public:
-    SearchServer() = default;
+    SearchServer();
     explicit SearchServer(istream& document_input);
+    ~SearchServer();
+
+    // Fails with invalid_argument if the name is taken. The calls taking an
+    // index name fail with out_of_range for a name never created.
+    void CreateIndex(const string& name, const IndexOptions& options = {});
+    vector<string> GetIndexNames() const;
+    // Share of the CPU workers the index's queries may hold at once,
+    // at least one worker; 1, the default, means no cap
+    void SetCpuQuota(string_view name, double share);
+
+    // Applies to the indexes built by later UpdateDocumentBase calls
+    void SetIndexOptions(const IndexOptions& options);
+    void SetIndexOptions(string_view name, const IndexOptions& options);
     void UpdateDocumentBase(istream& document_input);
+    void UpdateDocumentBase(string_view name, istream& document_input);
     void AddQueriesStream(istream& query_input,
-                          ostream& search_results_output);
+                          ostream& search_results_output,
+                          const StreamOptions& options = {});
+    void AddQueriesStream(string_view name,
+                          istream& query_input,
+                          ostream& search_results_output,
+                          const StreamOptions& options = {});
+    void AnswerQuery(string_view query,
+                     ostream& search_results_output);
+    void AnswerQuery(string_view query,
+                     ostream& search_results_output,
+                     const ResultPage& page);
+    void AnswerQuery(string_view name,
+                     string_view query,
+                     ostream& search_results_output,
+                     const ResultPage& page);
+    // Answers query on the CPU workers, within the index's CPU quota, and
+    // hands the result line to done there
+    void AnswerQueryAsync(string_view name,
+                          string query,
+                          function<void(string)> done,
+                          int priority = 0);
+    // Applies to AnswerQuery and to the streams added later
+    void SetResultPage(const ResultPage& page);
     void WaitForAllTasks();
 
+    // Writes a QueryExplanation of every sample_period-th query to
+    // explain_output; nullptr turns explaining off
+    void SetExplainOutput(ostream* explain_output, size_t sample_period = 1);
+
+    // Bytes an update may have in use at once, including the index being
+    // replaced and every other index; 0 means unlimited. An update that
+    // would not fit next to the current index drops it first; until the new
+    // one is in, queries are answered from an empty index and say it is
+    // rebuilding. Should that build fail, the index stays empty and its
+    // answers say so until an update succeeds. An update that would not fit
+    // at all fails with MemoryBudgetExceeded, reported by WaitForAllTasks,
+    // and keeps the current index.
+    void SetMemoryBudget(size_t bytes);
+    IndexMemoryUsage GetIndexMemoryUsage();
+    IndexMemoryUsage GetIndexMemoryUsage(string_view name);
+
+    // Bytes for merged postings of frequently co-queried term pairs, for
+    // each index; 0, the default, turns the TermPairCache off
+    void SetPairCacheBudget(size_t bytes);
+    // Summed over all indexes
+    TermPairCache::Stats GetPairCacheStats() const;
+
+    // Throughput of each AddQueriesStream stage since the server started,
+    // over all indexes or for one
+    StageStats GetStageStats(QueryStage stage) const;
+    StageStats GetStageStats(string_view name, QueryStage stage) const;
+    size_t GetDeadlineMisses() const;
+
 private:
-    Synchronized<InvertedIndex> m_index;
+    // Threads blocked on query or result streams, or building indexes
+    static const size_t MAX_IO_THREADS = 256;
+    static constexpr string_view DEFAULT_INDEX{};
+
+    IndexTenant& GetTenant(string_view name) const;
+    vector<IndexTenant*> GetTenants() const;
+    // What an update of tenant may use next to the other indexes
+    size_t MemoryBudgetFor(const IndexTenant& tenant, size_t memory_budget) const;
+
+    ResultPage m_resultPage;
+    size_t m_memoryBudget = 0;
+    size_t m_pairCacheBudget = 0;
+    ExplainSink m_explain;
+    HitsBufferPool m_hitsBuffers;
+    // Declared before the executors, which finish their tasks on destruction
+    mutable mutex m_tenantsMutex;
+    map<string, unique_ptr<IndexTenant>, less<>> m_tenants;
     vector<future<void>> m_tasks;
+    PriorityScheduler m_cpuScheduler;
+    ThreadPool m_ioExecutor{1, MAX_IO_THREADS};
 };
+
+template <typename DocHitsMap>
+void InvertedIndex::LookupAndSum(string_view word,
+                                 DocHitsMap& docid_count) const
+{
+    auto [first, last] = ResolveWord(word);
+
+    for (size_t term = first; term < last; ++term)
+    {
+        SumTerm(term, docid_count);
+    }
+}
+
+template <typename DocHitsMap>
+void InvertedIndex::SumPlan(const vector<QueryTerm>& plan,
+                            DocHitsMap& docid_count) const
+{
+    for (const auto& queryTerm : plan)
+    {
+        for (size_t term = queryTerm.first; term < queryTerm.last; ++term)
+        {
+            SumTerm(term, docid_count, queryTerm.multiplicity);
+        }
+    }
+}
+
+template <typename DocHitsMap>
+void InvertedIndex::SumTerm(size_t term, DocHitsMap& docid_count, size_t weight) const
+{
+    if (m_options.postings == PostingsLayout::PerTerm)
+    {
+        SumPostings(m_postings[term], docid_count, weight);
+        return;
+    }
+
+    const auto last = m_hits.begin() + m_hitOffsets[term + 1];
+
+    for (auto it = m_hits.begin() + m_hitOffsets[term]; it != last; ++it)
+    {
+        docid_count[it->first] += it->second * weight;
+    }
+}
+
+template <typename DocHitsMap>
+void InvertedIndex::SumPostings(const TermPostings& postings,
+                                DocHitsMap& docid_count,
+                                size_t weight)
+{
+    for (auto& [docid, hits] : postings.hits)
+    {
+        docid_count[docid] += hits * weight;
+    }
+    postings.single_hits.ForEach([&docid_count, weight](size_t docid)
+    {
+        docid_count[docid] += weight;
+    });
+}
@@ -0,0 +1,369 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+#include <system_error>
+#include <thread>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "shard.h"
+#include "parse.h"
+
+using namespace std;
+
+namespace
+{
+enum class RequestType : uint64_t
+{
+    Query = 0,
+    Shutdown = 1
+};
+
+[[noreturn]] void ThrowSystemError(const char* what)
+{
+    throw system_error(errno, generic_category(), what);
+}
+
+// Returns false if the peer closed the connection; no SIGPIPE is raised
+bool WriteAll(int fd, const char* data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t written = send(fd, data, size, MSG_NOSIGNAL);
+
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EPIPE || errno == ECONNRESET)
+                return false;
+            ThrowSystemError("shard socket write");
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+// Returns false if the peer closed the connection before any byte was read
+bool ReadAll(int fd, char* data, size_t size)
+{
+    size_t done = 0;
+
+    while (done < size)
+    {
+        ssize_t got = read(fd, data + done, size - done);
+
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got < 0 && errno != ECONNRESET)
+            ThrowSystemError("shard socket read");
+        if (got <= 0)
+        {
+            if (done == 0)
+                return false;
+            throw runtime_error("shard socket closed in the middle of a message");
+        }
+        done += got;
+    }
+    return true;
+}
+
+sockaddr_un MakeAddress(const string& socket_path)
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+
+    if (socket_path.size() >= sizeof(address.sun_path))
+        throw invalid_argument("shard socket path is too long: " + socket_path);
+
+    strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+    return address;
+}
+
+int ConnectWithRetry(const string& socket_path)
+{
+    static const auto CONNECT_TIMEOUT = chrono::seconds(30);
+    const auto address = MakeAddress(socket_path);
+    const auto deadline = chrono::steady_clock::now() + CONNECT_TIMEOUT;
+
+    for (;;)
+    {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+        if (fd < 0)
+            ThrowSystemError("shard socket");
+
+        if (connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0)
+            return fd;
+
+        // The worker may still be building its index
+        int error = errno;
+        close(fd);
+
+        if ((error != ENOENT && error != ECONNREFUSED)
+                || chrono::steady_clock::now() > deadline)
+        {
+            errno = error;
+            ThrowSystemError("shard connect");
+        }
+        this_thread::sleep_for(chrono::milliseconds(10));
+    }
+}
+}
+
+void MessageBuffer::Clear()
+{
+    m_data.clear();
+    m_readPos = 0;
+}
+
+void MessageBuffer::PutU64(uint64_t value)
+{
+    const char* bytes = reinterpret_cast<const char*>(&value);
+    m_data.insert(m_data.end(), bytes, bytes + sizeof(value));
+}
+
+void MessageBuffer::PutString(string_view value)
+{
+    PutU64(value.size());
+    m_data.insert(m_data.end(), value.begin(), value.end());
+}
+
+uint64_t MessageBuffer::GetU64()
+{
+    uint64_t value;
+
+    if (m_readPos + sizeof(value) > m_data.size())
+        throw runtime_error("truncated shard message");
+
+    memcpy(&value, m_data.data() + m_readPos, sizeof(value));
+    m_readPos += sizeof(value);
+    return value;
+}
+
+string_view MessageBuffer::GetString()
+{
+    const size_t size = GetU64();
+
+    if (m_readPos + size > m_data.size())
+        throw runtime_error("truncated shard message");
+
+    string_view value(m_data.data() + m_readPos, size);
+    m_readPos += size;
+    return value;
+}
+
+bool MessageBuffer::Send(int fd) const
+{
+    const uint64_t size = m_data.size();
+    return WriteAll(fd, reinterpret_cast<const char*>(&size), sizeof(size))
+        && WriteAll(fd, m_data.data(), m_data.size());
+}
+
+bool MessageBuffer::Receive(int fd)
+{
+    uint64_t size;
+    Clear();
+
+    if (!ReadAll(fd, reinterpret_cast<char*>(&size), sizeof(size)))
+        return false;
+
+    m_data.resize(size);
+
+    if (size > 0 && !ReadAll(fd, m_data.data(), size))
+        throw runtime_error("shard socket closed in the middle of a message");
+    return true;
+}
+
+ShardWorker::ShardWorker(istream& document_input, size_t first_docid, size_t docs_count) :
+    m_firstDocid(first_docid)
+{
+    // Docids count non-empty lines only, the same way InvertedIndex does
+    ostringstream shard_documents;
+    size_t docid = 0;
+
+    for (string document; docid < first_docid + docs_count && getline(document_input, document); )
+    {
+        if (document.empty())
+            continue;
+
+        if (docid >= first_docid)
+            shard_documents << document << '\n';
+        ++docid;
+    }
+
+    istringstream shard_input(shard_documents.str());
+    m_index = InvertedIndex(shard_input);
+}
+
+void ShardWorker::Serve(const string& socket_path)
+{
+    const auto address = MakeAddress(socket_path);
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (listener < 0)
+        ThrowSystemError("shard socket");
+
+    unlink(socket_path.c_str());
+
+    if (bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0
+            || listen(listener, SOMAXCONN) < 0)
+    {
+        int error = errno;
+        close(listener);
+        errno = error;
+        ThrowSystemError("shard listen");
+    }
+
+    MessageBuffer request;
+    MessageBuffer response;
+
+    for (bool running = true; running; )
+    {
+        int connection = accept(listener, nullptr, nullptr);
+
+        if (connection < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            close(listener);
+            ThrowSystemError("shard accept");
+        }
+
+        try
+        {
+            while (running && request.Receive(connection))
+            {
+                running = HandleRequest(request, response);
+
+                // The coordinator went away: wait for the next one
+                if (running && !response.Send(connection))
+                    break;
+            }
+        }
+        catch (...)
+        {
+            close(connection);
+            close(listener);
+            throw;
+        }
+        close(connection);
+    }
+    close(listener);
+    unlink(socket_path.c_str());
+}
+
+bool ShardWorker::HandleRequest(MessageBuffer& request, MessageBuffer& response)
+{
+    if (static_cast<RequestType>(request.GetU64()) == RequestType::Shutdown)
+        return false;
+
+    const auto plan = m_index.PlanQuery(SplitIntoWordsView(request.GetString()));
+    m_docHits.assign(m_index.DocsCount(), 0);
+    m_index.SumPlan(plan, m_docHits);
+
+    SearchResult search_result(MAX_OUTPUT);
+    search_result.Select(m_docHits, m_firstDocid);
+
+    response.Clear();
+    response.PutU64(search_result.size());
+
+    for (auto [docid, hitcount] : search_result)
+    {
+        response.PutU64(docid);
+        response.PutU64(hitcount);
+    }
+    return true;
+}
+
+ShardCoordinator::ShardCoordinator(const vector<string>& shard_sockets) :
+    m_responses(shard_sockets.size())
+{
+    try
+    {
+        for (const auto& socket_path : shard_sockets)
+        {
+            m_shards.push_back(ConnectWithRetry(socket_path));
+        }
+    }
+    catch (...)
+    {
+        for (int fd : m_shards)
+        {
+            close(fd);
+        }
+        throw;
+    }
+}
+
+ShardCoordinator::~ShardCoordinator()
+{
+    for (int fd : m_shards)
+    {
+        close(fd);
+    }
+}
+
+void ShardCoordinator::AddQueriesStream(istream& query_input,
+                                        ostream& search_results_output)
+{
+    for (string current_query; getline(query_input, current_query); )
+    {
+        if (current_query.empty())
+            continue;
+
+        m_request.Clear();
+        m_request.PutU64(static_cast<uint64_t>(RequestType::Query));
+        m_request.PutString(current_query);
+
+        // Send to every shard before reading so the shards search in parallel
+        for (int fd : m_shards)
+        {
+            if (!m_request.Send(fd))
+                throw runtime_error("shard closed the connection");
+        }
+
+        m_candidates.clear();
+
+        for (size_t shard = 0; shard < m_shards.size(); ++shard)
+        {
+            MessageBuffer& response = m_responses[shard];
+
+            if (!response.Receive(m_shards[shard]))
+                throw runtime_error("shard closed the connection");
+
+            for (size_t count = response.GetU64(); count > 0; --count)
+            {
+                const size_t docid = response.GetU64();
+                m_candidates.emplace_back(docid, response.GetU64());
+            }
+        }
+
+        // Feeding candidates in docid order keeps the single-server tie order
+        sort(m_candidates.begin(), m_candidates.end());
+        SearchResult search_result(MAX_OUTPUT);
+
+        for (auto& candidate : m_candidates)
+        {
+            search_result.PushBack(move(candidate));
+        }
+        PrintSearchResult(search_results_output, current_query, search_result);
+    }
+}
+
+void ShardCoordinator::ShutdownShards()
+{
+    m_request.Clear();
+    m_request.PutU64(static_cast<uint64_t>(RequestType::Shutdown));
+
+    for (int fd : m_shards)
+    {
+        if (!m_request.Send(fd))
+            throw runtime_error("shard closed the connection");
+    }
+}
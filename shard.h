@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "search_server.h"
+
+using namespace std;
+
+// Length-prefixed binary message exchanged between coordinator and shards.
+// Storage is kept between Clear() calls so one buffer serves many requests.
+class MessageBuffer
+{
+public:
+    void Clear();
+    void PutU64(uint64_t value);
+    void PutString(string_view value);
+    uint64_t GetU64();
+    string_view GetString();
+
+    // Both return false if the peer closed the connection between messages
+    bool Send(int fd) const;
+    bool Receive(int fd);
+
+private:
+    vector<char> m_data;
+    size_t m_readPos = 0;
+};
+
+// Owns the index of documents [first_docid, first_docid + docs_count) of a
+// document base and answers queries for them over a Unix domain socket
+class ShardWorker
+{
+public:
+    ShardWorker(istream& document_input, size_t first_docid, size_t docs_count);
+    // Serves one connection at a time until a Shutdown request, so it is
+    // meant for a single ShardCoordinator: a second one connecting meanwhile
+    // waits until the first disconnects
+    void Serve(const string& socket_path);
+
+private:
+    bool HandleRequest(MessageBuffer& request, MessageBuffer& response);
+
+    InvertedIndex m_index;
+    size_t m_firstDocid;
+    vector<size_t> m_docHits;
+};
+
+// Fans queries out to all shards and merges their top results
+class ShardCoordinator
+{
+public:
+    explicit ShardCoordinator(const vector<string>& shard_sockets);
+    ~ShardCoordinator();
+    ShardCoordinator(const ShardCoordinator&) = delete;
+    ShardCoordinator& operator=(const ShardCoordinator&) = delete;
+
+    void AddQueriesStream(istream& query_input,
+                          ostream& search_results_output);
+    void ShutdownShards();
+
+private:
+    vector<int> m_shards;
+    MessageBuffer m_request;
+    vector<MessageBuffer> m_responses;
+    DocHits m_candidates;
+};
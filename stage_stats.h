@@ -0,0 +1,70 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+using namespace std;
+
+// Stages a query passes through in AddQueriesStream
+enum class QueryStage
+{
+    Read,
+    Parse,
+    Lookup,
+    Rank,
+    Format
+};
+
+const size_t QUERY_STAGE_COUNT = 5;
+
+const char* QueryStageName(QueryStage stage);
+
+struct StageStats
+{
+    size_t queries = 0;
+    chrono::nanoseconds busy{};
+
+    double QueriesPerSecond() const
+    {
+        return busy.count() > 0 ? queries * 1e9 / busy.count() : 0.0;
+    }
+};
+
+// Queries and busy time per stage, summed over all query streams
+class PipelineStats
+{
+public:
+    void Add(QueryStage stage, chrono::steady_clock::duration busy)
+    {
+        const size_t i = static_cast<size_t>(stage);
+        m_queries[i].fetch_add(1, memory_order_relaxed);
+        m_busyNs[i].fetch_add(chrono::duration_cast<chrono::nanoseconds>(busy).count(),
+                              memory_order_relaxed);
+    }
+
+    StageStats Get(QueryStage stage) const
+    {
+        const size_t i = static_cast<size_t>(stage);
+        StageStats result;
+        result.queries = m_queries[i].load(memory_order_relaxed);
+        result.busy = chrono::nanoseconds(m_busyNs[i].load(memory_order_relaxed));
+        return result;
+    }
+
+    void AddDeadlineMiss()
+    {
+        m_deadlineMisses.fetch_add(1, memory_order_relaxed);
+    }
+
+    size_t DeadlineMisses() const
+    {
+        return m_deadlineMisses.load(memory_order_relaxed);
+    }
+
+private:
+    array<atomic<size_t>, QUERY_STAGE_COUNT> m_queries{};
+    array<atomic<int64_t>, QUERY_STAGE_COUNT> m_busyNs{};
+    atomic<size_t> m_deadlineMisses = 0;
+};
@@ -0,0 +1,168 @@
+#include <algorithm>
+
+#include "term_dictionary.h"
+
+using namespace std;
+
+namespace
+{
+void PutVarint(string& out, size_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back(static_cast<char>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+size_t GetVarint(const char*& in)
+{
+    size_t value = 0;
+
+    for (int shift = 0; ; shift += 7)
+    {
+        const auto byte = static_cast<unsigned char>(*in++);
+        value |= size_t(byte & 0x7f) << shift;
+
+        if (!(byte & 0x80))
+            return value;
+    }
+}
+
+size_t CommonPrefix(string_view lhs, string_view rhs)
+{
+    return mismatch(lhs.begin(), lhs.begin() + min(lhs.size(), rhs.size()), rhs.begin()).first
+           - lhs.begin();
+}
+}
+
+CompactTermDictionary::CompactTermDictionary(const vector<string_view>& terms) :
+    m_size(terms.size())
+{
+    m_blockOffsets.reserve((terms.size() + BLOCK_SIZE - 1) / BLOCK_SIZE);
+
+    for (size_t i = 0; i < terms.size(); ++i)
+    {
+        if (i % BLOCK_SIZE == 0)
+        {
+            m_blockOffsets.push_back(static_cast<uint32_t>(m_bytes.size()));
+            PutVarint(m_bytes, terms[i].size());
+            m_bytes += terms[i];
+        }
+        else
+        {
+            const size_t shared = CommonPrefix(terms[i - 1], terms[i]);
+            PutVarint(m_bytes, shared);
+            PutVarint(m_bytes, terms[i].size() - shared);
+            m_bytes.append(terms[i].substr(shared));
+        }
+    }
+    m_bytes.shrink_to_fit();
+}
+
+string_view CompactTermDictionary::BlockHead(size_t block) const
+{
+    const char* in = m_bytes.data() + m_blockOffsets[block];
+    const size_t size = GetVarint(in);
+    return {in, size};
+}
+
+template <typename Func>
+void CompactTermDictionary::ForEachFrom(size_t ordinal, Func func) const
+{
+    string term;
+
+    for (size_t block = ordinal / BLOCK_SIZE; block < m_blockOffsets.size(); ++block)
+    {
+        const char* in = m_bytes.data() + m_blockOffsets[block];
+        const size_t blockEnd = min(m_size, (block + 1) * BLOCK_SIZE);
+
+        for (size_t current = block * BLOCK_SIZE; current < blockEnd; ++current)
+        {
+            size_t shared = 0;
+
+            if (current != block * BLOCK_SIZE)
+                shared = GetVarint(in);
+
+            const size_t suffix = GetVarint(in);
+            term.resize(shared);
+            term.append(in, suffix);
+            in += suffix;
+
+            if (current >= ordinal && !func(string_view(term), current))
+                return;
+        }
+    }
+}
+
+pair<size_t, bool> CompactTermDictionary::Seek(string_view key) const
+{
+    // Last block whose head term is not greater than key
+    size_t first = 0;
+    size_t count = m_blockOffsets.size();
+
+    while (count > 0)
+    {
+        const size_t step = count / 2;
+
+        if (BlockHead(first + step) <= key)
+        {
+            first += step + 1;
+            count -= step + 1;
+        }
+        else
+        {
+            count = step;
+        }
+    }
+    if (first == 0)
+        return {0, false};
+
+    const size_t block = first - 1;
+    pair<size_t, bool> result(min(m_size, first * BLOCK_SIZE), false);
+
+    ForEachFrom(block * BLOCK_SIZE, [&](string_view term, size_t ordinal)
+    {
+        if (ordinal >= first * BLOCK_SIZE)
+            return false;
+
+        if (term >= key)
+        {
+            result = {ordinal, term == key};
+            return false;
+        }
+        return true;
+    });
+    return result;
+}
+
+size_t CompactTermDictionary::LowerBound(string_view key) const
+{
+    return Seek(key).first;
+}
+
+optional<size_t> CompactTermDictionary::Find(string_view term) const
+{
+    const auto [ordinal, found] = Seek(term);
+
+    if (!found)
+        return nullopt;
+    return ordinal;
+}
+
+pair<size_t, size_t> CompactTermDictionary::PrefixRange(string_view prefix, size_t max_terms) const
+{
+    const size_t first = LowerBound(prefix);
+    size_t last = first;
+
+    ForEachFrom(first, [&](string_view term, size_t)
+    {
+        if (last - first == max_terms || term.substr(0, prefix.size()) != prefix)
+            return false;
+
+        ++last;
+        return true;
+    });
+    return {first, last};
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Sorted term set stored front-coded in one byte array: every BLOCK_SIZE-th
+// term is kept whole, the others as (shared prefix length, suffix).
+// Terms are identified by their ordinal in sorted order.
+class CompactTermDictionary
+{
+public:
+    CompactTermDictionary() = default;
+    // terms must be sorted and unique
+    explicit CompactTermDictionary(const vector<string_view>& terms);
+
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    optional<size_t> Find(string_view term) const;
+    // Ordinal of the first term not less than key
+    size_t LowerBound(string_view key) const;
+    // Ordinals [first, last) of at most max_terms terms starting with prefix
+    pair<size_t, size_t> PrefixRange(string_view prefix, size_t max_terms) const;
+
+    size_t MemoryBytes() const
+    {
+        return m_bytes.capacity() + m_blockOffsets.capacity() * sizeof(uint32_t);
+    }
+
+private:
+    static const size_t BLOCK_SIZE = 16;
+
+    string_view BlockHead(size_t block) const;
+    // LowerBound() and whether the term found there equals key
+    pair<size_t, bool> Seek(string_view key) const;
+    // Calls func(term, ordinal) for terms from ordinal on while it returns true
+    template <typename Func>
+    void ForEachFrom(size_t ordinal, Func func) const;
+
+    string m_bytes;
+    vector<uint32_t> m_blockOffsets;
+    size_t m_size = 0;
+};
@@ -1,5 +1,8 @@
 #include "test_runner.h"
 
+#include <cmath>
+#include <fstream>
+
 using namespace std;
 
 //---------------------------------------------------------------------------//
@@ -50,9 +53,102 @@ void Assert(bool b,
     }
 }
 
+//---------------------------------------------------------------------------//
+double BenchResult::OpsPerSecond() const
+{
+    return median_ns > 0 ? 1e9 / median_ns : 0;
+}
+
+//---------------------------------------------------------------------------//
+ostream& operator << (ostream& os, const BenchResult& result)
+{
+    return os << "median: " << result.median_ns << " ns"
+              << ", mad: " << result.mad_ns << " ns"
+              << ", ops/s: " << result.OpsPerSecond()
+              << ", iterations: " << result.iterations;
+}
+
+//---------------------------------------------------------------------------//
+BenchResult SummarizeBench(vector<double> ns_per_op, size_t iterations)
+{
+    BenchResult result;
+    result.iterations = iterations;
+
+    if (ns_per_op.empty())
+        return result;
+
+    auto median = [](vector<double>& values)
+    {
+        sort(values.begin(), values.end());
+        const size_t middle = values.size() / 2;
+        return values.size() % 2 ? values[middle]
+                                  : (values[middle - 1] + values[middle]) / 2;
+    };
+    result.median_ns = median(ns_per_op);
+
+    for (auto& value : ns_per_op)
+    {
+        value = abs(value - result.median_ns);
+    }
+    result.mad_ns = median(ns_per_op);
+    return result;
+}
+
+//---------------------------------------------------------------------------//
+void TestRunner::SetBenchBaseline(const string& path, double tolerance, bool record)
+{
+    baseline_path = path;
+    baseline_tolerance = tolerance;
+    record_baseline = record;
+    baseline.clear();
+
+    // One "name median_ns" per line; a missing file is an empty baseline
+    ifstream in(path);
+    string name;
+    double median_ns;
+
+    while (in >> name >> median_ns)
+    {
+        baseline[name] = median_ns;
+    }
+}
+
+//---------------------------------------------------------------------------//
+void TestRunner::ReportBench(const string& bench_name, const BenchResult& result)
+{
+    auto found = baseline.find(bench_name);
+    const bool compare = !record_baseline && found != baseline.end();
+
+    if (record_baseline)
+        baseline[bench_name] = result.median_ns;
+
+    if (compare && result.median_ns > found->second * (1 + baseline_tolerance))
+    {
+        ++fail_count;
+        cerr << bench_name << " fail. " << result
+             << ". Regressed from baseline " << found->second << " ns" << endl;
+        return;
+    }
+    cerr << bench_name << ' ' << result;
+
+    if (compare)
+        cerr << ", baseline: " << found->second << " ns";
+
+    cerr << endl;
+}
+
 //---------------------------------------------------------------------------//
 TestRunner::~TestRunner()
 {
+    if (record_baseline && !baseline_path.empty())
+    {
+        ofstream out(baseline_path);
+
+        for (const auto& [name, median_ns] : baseline)
+        {
+            out << name << ' ' << median_ns << '\n';
+        }
+    }
     if (fail_count > 0)
     {
         cerr << fail_count << " unit tests failed. Terminate" << endl;
@@ -1,6 +1,9 @@
 #ifndef UNITTESTS_H_
 #define UNITTESTS_H_
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <sstream>
 #include <iostream>
 #include <exception>
@@ -71,6 +74,63 @@ void Assert(bool b,
 #define ASSERT(t) \
     Assert(t, #t, {__FILE__, __LINE__, ""}, "");
 
+//===========================================================================//
+// Benchmark helpers
+//---------------------------------------------------------------------------//
+// Makes the compiler assume value is read, so computing it is not elided
+template <class T>
+inline void DoNotOptimize(const T& value);
+
+//---------------------------------------------------------------------------//
+// Makes the compiler assume all memory is read and written
+inline void ClobberMemory();
+
+//---------------------------------------------------------------------------//
+struct BenchOptions
+{
+    unsigned warmup = 2;
+    unsigned repetitions = 15;
+    // Each repetition runs the operation at least this long
+    std::chrono::nanoseconds min_time = std::chrono::milliseconds(20);
+};
+
+//---------------------------------------------------------------------------//
+struct BenchResult
+{
+    size_t iterations = 0;  // per repetition
+    double median_ns = 0;   // per operation
+    double mad_ns = 0;      // median absolute deviation from median_ns
+    double OpsPerSecond() const;
+};
+
+std::ostream& operator << (std::ostream& os, const BenchResult& result);
+
+//---------------------------------------------------------------------------//
+BenchResult SummarizeBench(std::vector<double> ns_per_op, size_t iterations);
+
+//---------------------------------------------------------------------------//
+// Passed to a benchmark function, which prepares its data and then hands
+// the operation to time to Measure()
+class Benchmark
+{
+public:
+    explicit Benchmark(const BenchOptions& options)
+        : m_options(options)
+    {
+    }
+    template <class Operation>
+    void Measure(Operation op);
+
+    const BenchResult& Result() const
+    {
+        return m_result;
+    }
+
+private:
+    BenchOptions m_options;
+    BenchResult m_result;
+};
+
 //===========================================================================//
 class TestRunner
 {
@@ -79,8 +139,22 @@ public:
     template <class TestFunc>
     void RunTest(TestFunc func, const std::string& test_name);
 
+    // Benchmarks whose median is more than tolerance (0.1 is 10%) above the
+    // one stored in path fail. With record the results replace the stored
+    // ones when the runner is destroyed.
+    void SetBenchBaseline(const std::string& path, double tolerance, bool record = false);
+    template <class BenchFunc>
+    void RunBench(BenchFunc func, const std::string& bench_name,
+                  const BenchOptions& options = {});
+
 private:
+    void ReportBench(const std::string& bench_name, const BenchResult& result);
+
     int fail_count = 0;
+    std::string baseline_path;
+    double baseline_tolerance = 0;
+    bool record_baseline = false;
+    std::map<std::string, double> baseline;
 };
 
 //===========================================================================//
@@ -190,8 +264,93 @@ void TestRunner::RunTest(TestFunc func, const std::string& test_name)
     }
 }
 
+//---------------------------------------------------------------------------//
+template <class BenchFunc>
+void TestRunner::RunBench(BenchFunc func, const std::string& bench_name,
+                          const BenchOptions& options)
+{
+    try
+    {
+        Benchmark bench(options);
+        func(bench);
+        ReportBench(bench_name, bench.Result());
+    }
+    catch (std::runtime_error& e)
+    {
+        ++fail_count;
+        std::cerr << bench_name << " fail. " << e.what() << std::endl;
+    }
+}
+
+//===========================================================================//
+template <class T>
+inline void DoNotOptimize(const T& value)
+{
+#if defined(__GNUC__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &value;
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+}
+
+//---------------------------------------------------------------------------//
+inline void ClobberMemory()
+{
+#if defined(__GNUC__)
+    asm volatile("" : : : "memory");
+#else
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+}
+
+//---------------------------------------------------------------------------//
+template <class Operation>
+void Benchmark::Measure(Operation op)
+{
+    using Clock = std::chrono::steady_clock;
+
+    auto run = [&op](size_t iterations)
+    {
+        const auto start = Clock::now();
+
+        for (size_t i = 0; i < iterations; ++i)
+        {
+            op();
+        }
+        return Clock::now() - start;
+    };
+
+    // Calibration doubles the iterations until a run is long enough
+    size_t iterations = 1;
+
+    while (run(iterations) < m_options.min_time && iterations < (size_t(1) << 40))
+    {
+        iterations *= 2;
+    }
+    for (unsigned i = 0; i < m_options.warmup; ++i)
+    {
+        run(iterations);
+    }
+
+    std::vector<double> ns_per_op;
+    ns_per_op.reserve(m_options.repetitions);
+
+    for (unsigned i = 0; i < std::max(m_options.repetitions, 1u); ++i)
+    {
+        const std::chrono::duration<double, std::nano> elapsed = run(iterations);
+        ns_per_op.push_back(elapsed.count() / iterations);
+    }
+    m_result = SummarizeBench(std::move(ns_per_op), iterations);
+}
+
 //---------------------------------------------------------------------------//
 #define RUN_TEST(testRunner, testFunction) \
         testRunner.RunTest(testFunction, #testFunction);
 
+//---------------------------------------------------------------------------//
+#define RUN_BENCH(testRunner, benchFunction) \
+        testRunner.RunBench(benchFunction, #benchFunction);
+
 #endif /* UNITTESTS_H_ */
@@ -0,0 +1,63 @@
+#include "thread_pool.h"
+
+using namespace std;
+
+ThreadPool::ThreadPool(size_t threads, size_t max_threads)
+{
+    threads = max<size_t>(threads, 1);
+    m_maxThreads = max(threads, max_threads);
+    m_threads.reserve(threads);
+
+    for (size_t i = 0; i < threads; ++i)
+    {
+        m_threads.emplace_back([this] { WorkerLoop(); });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_hasTasks.notify_all();
+
+    for (auto& t : m_threads)
+    {
+        t.join();
+    }
+}
+
+void ThreadPool::Post(function<void()> task)
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_tasks.push_back(move(task));
+
+        if (!m_stopping && m_tasks.size() > m_idle && m_threads.size() < m_maxThreads)
+            m_threads.emplace_back([this] { WorkerLoop(); });
+    }
+    m_hasTasks.notify_one();
+}
+
+void ThreadPool::WorkerLoop()
+{
+    for (;;)
+    {
+        function<void()> task;
+        {
+            unique_lock<mutex> lock(m_mutex);
+            ++m_idle;
+            m_hasTasks.wait(lock, [this] { return m_stopping || !m_tasks.empty(); });
+            --m_idle;
+
+            // Pending tasks are still run on shutdown
+            if (m_tasks.empty())
+                return;
+
+            task = move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+        task();
+    }
+}
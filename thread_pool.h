@@ -0,0 +1,38 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "executor.h"
+
+using namespace std;
+
+// Worker threads executing posted tasks in FIFO order. With max_threads
+// above threads the pool grows whenever a task finds no idle worker, which
+// suits tasks that block on I/O; grown threads stay until destruction.
+class ThreadPool : public Executor
+{
+public:
+    explicit ThreadPool(size_t threads = thread::hardware_concurrency(),
+                        size_t max_threads = 0);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void Post(function<void()> task) override;
+
+private:
+    void WorkerLoop();
+
+    mutex m_mutex;
+    condition_variable m_hasTasks;
+    deque<function<void()>> m_tasks;
+    bool m_stopping = false;
+    size_t m_idle = 0;
+    size_t m_maxThreads;
+    vector<thread> m_threads;
+};
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+using DocHits = vector<pair<size_t, size_t>>;
+
+// Largest k served by a selector specialized for its k
+const size_t MAX_FIXED_TOP_K = 8;
+
+// Ranking order: more hits first, then lower docid
+inline bool RanksBefore(const pair<size_t, size_t>& lhs, const pair<size_t, size_t>& rhs)
+{
+    return lhs.second != rhs.second ? lhs.second > rhs.second : lhs.first < rhs.first;
+}
+
+// Keeps the K best in a sorted array. Docids arrive in increasing order, so
+// a document only gets in with strictly more hits than the current K-th,
+// and the insertion loops have a constant trip count the compiler unrolls.
+template <size_t K>
+void SelectTopFixed(const vector<size_t>& docHits, size_t docidOffset, DocHits& out)
+{
+    array<pair<size_t, size_t>, K> top{};
+    size_t count = 0;
+
+    for (size_t doc = 0; doc < docHits.size(); ++doc)
+    {
+        const size_t hits = docHits[doc];
+
+        if (hits == 0 || (count == K && hits <= top[K - 1].second))
+            continue;
+
+        size_t pos = count < K ? count++ : K - 1;
+
+        for ( ; pos > 0 && top[pos - 1].second < hits; --pos)
+        {
+            top[pos] = top[pos - 1];
+        }
+        top[pos] = {doc + docidOffset, hits};
+    }
+    out.assign(top.begin(), top.begin() + count);
+}
+
+// Keeps the k best in a heap with the worst on top: O(n log k)
+inline void SelectTopHeap(const vector<size_t>& docHits, size_t k, size_t docidOffset,
+                          DocHits& out)
+{
+    out.clear();
+
+    if (k == 0)
+        return;
+
+    for (size_t doc = 0; doc < docHits.size(); ++doc)
+    {
+        const size_t hits = docHits[doc];
+
+        if (hits == 0)
+            continue;
+
+        if (out.size() < k)
+        {
+            out.emplace_back(doc + docidOffset, hits);
+            push_heap(out.begin(), out.end(), RanksBefore);
+        }
+        else if (hits > out.front().second)
+        {
+            pop_heap(out.begin(), out.end(), RanksBefore);
+            out.back() = {doc + docidOffset, hits};
+            push_heap(out.begin(), out.end(), RanksBefore);
+        }
+    }
+    sort_heap(out.begin(), out.end(), RanksBefore);
+}
+
+namespace top_k_detail
+{
+using Selector = void (*)(const vector<size_t>&, size_t, DocHits&);
+
+template <size_t... K>
+constexpr array<Selector, sizeof...(K)> MakeFixedSelectors(index_sequence<K...>)
+{
+    return {&SelectTopFixed<K + 1>...};
+}
+
+constexpr auto FIXED_SELECTORS = MakeFixedSelectors(make_index_sequence<MAX_FIXED_TOP_K>());
+}
+
+// Writes the k best documents of docHits, in ranking order, to out
+inline void SelectTop(const vector<size_t>& docHits, size_t k, size_t docidOffset, DocHits& out)
+{
+    if (k == 0)
+        out.clear();
+    else if (k <= MAX_FIXED_TOP_K)
+        top_k_detail::FIXED_SELECTORS[k - 1](docHits, docidOffset, out);
+    else
+        SelectTopHeap(docHits, k, docidOffset, out);
+}